@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "colour_ramp.h"
+#include "noise.h"
+#include "noise_volume.h"
+#include "terrain_render.h"
+#include "y4m.h"
+
+#define BENCH_MAP_SIDE		2000
+#define BENCH_MAP_STEP		80
+#define BENCH_SAMPLES		(1 << 22)
+#define BENCH_FRAMES		50
+#define BENCH_VIEW_DEPTH	200
+
+/*
+ * Headless benchmarks for the library's kernels, each run in isolation on a
+ * fixed-seed map. Results are in nanoseconds per sample or milliseconds per
+ * frame; the checksums are only there so that nothing gets optimised away.
+ */
+
+static double seconds_since(Uint64 start) {
+	return (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+};
+
+static void report(const char *name, double seconds, unsigned long count, const char *unit, double checksum) {
+	if (0 == strcmp(unit, "frame"))
+		printf("%-32s %10.3f ms/frame   (checksum %g)\n", name, 1e3 * seconds / count, checksum);
+	else
+		printf("%-32s %10.3f ns/%s  (checksum %g)\n", name, 1e9 * seconds / count, unit, checksum);
+};
+
+void bench_elevation(const struct elevation_map *map) {
+	double checksum = 0.;
+	unsigned int map_x, map_y;
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (map_y = 0; map_y < map->height; ++map_y)
+		for (map_x = 0; map_x < map->width; ++map_x)
+			checksum += get_map_elevation(map, map_x, map_y);
+	report("get_map_elevation", seconds_since(start), (unsigned long) map->width * map->height, "sample", checksum);
+
+	float *row = (float*) malloc(map->width * sizeof(float));
+	checksum = 0.;
+	start = SDL_GetPerformanceCounter();
+	for (map_y = 0; map_y < map->height; ++map_y) {
+		get_map_row_elevations(map, 0, map_y, map->width, row);
+		checksum += row[map_y % map->width];
+	}
+	report("get_map_row_elevations", seconds_since(start), (unsigned long) map->width * map->height, "sample", checksum);
+	free(row);
+};
+
+void bench_kernels(struct elevation_map *map) {
+	/*
+	 * Every noise kernel that can handle the map's step, not just the one
+	 * the map would pick
+	 */
+	const struct noise_kernel *selected = map->kernel;
+	float *row = (float*) malloc(map->width * sizeof(float));
+
+	unsigned int kernel_idx, map_y;
+	for (kernel_idx = 0; kernel_idx < noise_kernel_count; ++kernel_idx) {
+		if (!noise_kernel_supports(&noise_kernels[kernel_idx], map->step))
+			continue;
+		map->kernel = &noise_kernels[kernel_idx];
+
+		double checksum = 0.;
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (map_y = 0; map_y < map->height; ++map_y) {
+			get_map_row_noise(map, 0, map_y, map->width, row);
+			checksum += row[map_y % map->width];
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "row noise (%s)", map->kernel->name);
+		report(name, seconds_since(start), (unsigned long) map->width * map->height, "sample", checksum);
+	}
+
+	map->kernel = selected;
+	free(row);
+};
+
+void bench_volume(unsigned int width, unsigned int height) {
+	// A frame's worth of animated noise, as perlin --animate draws it
+	struct noise_volume volume = {
+		.width = width,
+		.height = height,
+		.step = BENCH_MAP_STEP,
+		.period = 16,
+		.node_vectors = NULL,
+	};
+	volume.width += BENCH_MAP_STEP - width % BENCH_MAP_STEP;
+	volume.height += BENCH_MAP_STEP - height % BENCH_MAP_STEP;
+	create_noise_volume(&volume);
+	float *row = (float*) malloc(width * sizeof(float));
+
+	double checksum = 0.;
+	unsigned int frame, map_y;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < BENCH_FRAMES; ++frame)
+		for (map_y = 0; map_y < height; ++map_y) {
+			get_volume_row_noise(&volume, 0, map_y, frame * 1.5, width, row);
+			checksum += row[map_y % width];
+		}
+	report("get_volume_row_noise", seconds_since(start), (unsigned long) BENCH_FRAMES * width * height, "sample", checksum);
+
+	free(row);
+	free_noise_volume(&volume);
+};
+
+void bench_sampling(const struct elevation_map *map) {
+	float *xs = (float*) malloc(BENCH_SAMPLES * sizeof(float));
+	float *ys = (float*) malloc(BENCH_SAMPLES * sizeof(float));
+	float *elevations = (float*) malloc(BENCH_SAMPLES * sizeof(float));
+
+	// Rows of rays, much like render_terrain casts them
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx < BENCH_SAMPLES; ++sample_idx) {
+		xs[sample_idx] = (sample_idx % 1000) + 500.25;
+		ys[sample_idx] = (sample_idx / 1000) % 1000 + 500.75;
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	sample_elevations(map, BENCH_SAMPLES, xs, ys, elevations);
+	double seconds = seconds_since(start);
+
+	double checksum = 0.;
+	for (sample_idx = 0; sample_idx < BENCH_SAMPLES; sample_idx += 4096)
+		checksum += elevations[sample_idx];
+	report("sample_elevations", seconds, BENCH_SAMPLES, "sample", checksum);
+
+	free(xs);
+	free(ys);
+	free(elevations);
+};
+
+void bench_ramp(struct colour_ramp *ramp) {
+	double checksum = 0.;
+	SDL_Color colour;
+	unsigned int sample_idx;
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (sample_idx = 0; sample_idx < BENCH_SAMPLES; ++sample_idx) {
+		elevation_to_colour((float) sample_idx / BENCH_SAMPLES, ramp, &colour);
+		checksum += colour.g;
+	}
+	report("elevation_to_colour", seconds_since(start), BENCH_SAMPLES, "sample", checksum);
+
+	checksum = 0.;
+	start = SDL_GetPerformanceCounter();
+	for (sample_idx = 0; sample_idx < BENCH_SAMPLES; ++sample_idx)
+		checksum += (elevation_to_pixel(ramp, (float) sample_idx / BENCH_SAMPLES) >> 8) & 0xFF;
+	report("elevation_to_pixel", seconds_since(start), BENCH_SAMPLES, "sample", checksum);
+};
+
+void bench_render(const struct elevation_map *map, unsigned int threads, unsigned int width, unsigned int height) {
+	struct terrain_renderer renderer;
+	init_terrain_renderer(&renderer, threads, width, BENCH_VIEW_DEPTH);
+
+	struct pixel_buffer target = {
+		.width = width,
+		.height = height,
+		.pixels = (Uint32*) malloc((size_t) width * height * sizeof(Uint32)),
+	};
+
+	// Without and with lighting
+	unsigned int shading;
+	for (shading = 0; shading < 2; ++shading) {
+		renderer.shading = shading;
+
+		double checksum = 0.;
+		unsigned int frame;
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (frame = 0; frame < BENCH_FRAMES; ++frame) {
+			struct vector camera = {
+				.x = map->width / 2 + frame * .7,
+				.y = 3 * map->height / 4 - frame * 1.3,
+			};
+			render_terrain(&renderer, &target, map, &camera);
+			checksum += target.pixels[(size_t) (height - 1) * width + width / 2] & 0xFF;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "render_terrain %ux%u%s", width, height, shading ? " shaded" : "");
+		report(name, seconds_since(start), BENCH_FRAMES, "frame", checksum);
+	}
+
+	free(target.pixels);
+	free_terrain_renderer(&renderer);
+};
+
+void bench_yuv(unsigned int width, unsigned int height) {
+	// What the video writer does to every frame, before writing it
+	width &= ~1;
+	height &= ~1;
+	Uint32 *pixels = (Uint32*) malloc((size_t) width * height * sizeof(Uint32));
+	Uint8 *planes = (Uint8*) malloc((size_t) width * height * 3 / 2);
+	size_t pixel_idx;
+	for (pixel_idx = 0; pixel_idx < (size_t) width * height; ++pixel_idx)
+		pixels[pixel_idx] = (Uint32) (pixel_idx * 2654435761u) & 0xFFFFFF;
+
+	double checksum = 0.;
+	unsigned int frame;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (frame = 0; frame < BENCH_FRAMES; ++frame) {
+		argb_to_yuv420(pixels, width, height, width, planes, planes + width * height, planes + width * height * 5 / 4);
+		checksum += planes[frame];
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "argb_to_yuv420 %ux%u", width, height);
+	report(name, seconds_since(start), BENCH_FRAMES, "frame", checksum);
+
+	free(pixels);
+	free(planes);
+};
+
+int main(int argc, char **argv) {
+	// Extra rendering threads on top of the calling one
+	int cpu_count = SDL_GetCPUCount();
+	unsigned int threads = (cpu_count > 1) ? cpu_count - 1 : 0;
+	unsigned int width = 1920, height = 1080;
+
+	int arg_idx;
+	for (arg_idx = 1; arg_idx + 1 < argc; arg_idx += 2) {
+		if (0 == strcmp(argv[arg_idx], "-j"))
+			threads = atoi(argv[arg_idx + 1]);
+		else if (0 == strcmp(argv[arg_idx], "-s"))
+			sscanf(argv[arg_idx + 1], "%ux%u", &width, &height);
+	}
+
+	srand(1);
+
+	struct elevation_map map = {
+		.width = BENCH_MAP_SIDE,
+		.height = BENCH_MAP_SIDE,
+		.step = BENCH_MAP_STEP,
+		.colour_ramp = &(struct colour_ramp) {
+			.min=0.,
+			.max=1.,
+			.min_colour=hex_to_colour(0x000080),
+			.max_colour=hex_to_colour(0xFFFFFF),
+			.gradients=NULL,
+		},
+		.node_vectors = NULL,
+		.elevations = NULL,
+	};
+	push_gradient(map.colour_ramp, 0.3, hex_to_colour(0x228B22));
+	push_gradient(map.colour_ramp, 0.85, hex_to_colour(0xC19A6B));
+	push_gradient(map.colour_ramp, 0.95, hex_to_colour(0xC8C8C8));
+	build_ramp_lut(map.colour_ramp);
+
+	create_noise_vectors(&map);
+	Uint64 start = SDL_GetPerformanceCounter();
+	cache_elevations(&map);
+	report("cache_elevations", seconds_since(start), (unsigned long) map.width * map.height, "sample", map.elevations[0]);
+
+	bench_elevation(&map);
+	bench_kernels(&map);
+	bench_volume(width, height);
+	bench_sampling(&map);
+	bench_ramp(map.colour_ramp);
+	bench_render(&map, threads, width, height);
+	bench_yuv(width, height);
+
+	free_elevation_map(&map);
+	free_colour_ramp(map.colour_ramp);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "SDL.h"
+
+#include "colour_ramp.h"
+#include "noise.h"
+#include "noise_volume.h"
+#include "plasma.h"
+#include "terrain_config.h"
+#include "terrain_render.h"
+
+// xorshift takes a while to get going from small seeds
+#define GOLDEN_SEED			0x9E3779B9
+// Largest acceptable per-channel difference from a reference image
+#define GOLDEN_TOLERANCE	2
+#define GOLDEN_FRAME_WIDTH	640
+#define GOLDEN_FRAME_HEIGHT	360
+#define GOLDEN_THREADS		3
+// The plasma as plasma draws it, at a fixed tick
+#define GOLDEN_PLASMA_WIDTH	160
+#define GOLDEN_PLASMA_HEIGHT	90
+#define GOLDEN_PLASMA_TICK	300
+
+// How far the optimised kernels may stray from the straightforward ones
+#define GOLDEN_NOISE_EPSILON	1e-5
+// Central differences are only so good, their error grows as cells shrink
+#define GOLDEN_SLOPE_EPSILON(step)	(10. / ((double) (step) * (step) * (step)))
+
+/*
+ * Regression checks for everything that has a fast path, headless and with
+ * fixed seeds:
+ *
+ *   golden record DIR   renders the reference images into DIR
+ *   golden check DIR    renders them again and compares them with DIR's
+ *
+ * Both also cross-check every kernel variant against the scalar code it
+ * replaces, which needs no reference images at all. Lattices are seeded
+ * with lattice_seed rather than rand(), so that the references in golden/
+ * hold whatever the C library. ctest runs golden check against them.
+ */
+
+struct golden_image {
+	const char *name;
+	unsigned int width;
+	unsigned int height;
+	// 1 (grey) or 3 (RGB) bytes per pixel
+	unsigned int channels;
+	Uint8 *pixels;
+};
+
+static unsigned int failures = 0;
+
+static void report_check(const char *name, bool passed, const char *format, double value) {
+	printf("%-40s %s  (", name, passed ? "ok  " : "FAIL");
+	printf(format, value);
+	printf(")\n");
+	if (!passed)
+		failures++;
+};
+
+static struct golden_image new_image(const char *name, unsigned int width, unsigned int height, unsigned int channels) {
+	return (struct golden_image) {
+		.name = name,
+		.width = width,
+		.height = height,
+		.channels = channels,
+		.pixels = (Uint8*) calloc((size_t) width * height, channels),
+	};
+};
+
+static int write_image(const char *directory, const struct golden_image *image) {
+	char path[FILENAME_MAX];
+	snprintf(path, sizeof(path), "%s/%s.%s", directory, image->name, (1 == image->channels) ? "pgm" : "ppm");
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s for writing\n", path);
+		return -1;
+	}
+	fprintf(file, "P%c\n%u %u\n255\n", (1 == image->channels) ? '5' : '6', image->width, image->height);
+	size_t size = (size_t) image->width * image->height * image->channels;
+	int status = (size == fwrite(image->pixels, 1, size, file)) ? 0 : -1;
+	if (0 != fclose(file))
+		status = -1;
+	return status;
+};
+
+static int read_image(const char *directory, struct golden_image *image) {
+	// Only reads back what write_image writes
+	char path[FILENAME_MAX];
+	snprintf(path, sizeof(path), "%s/%s.%s", directory, image->name, (1 == image->channels) ? "pgm" : "ppm");
+
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return -1;
+	}
+
+	char magic;
+	unsigned int width, height, maxval;
+	int status = 0;
+	if (4 != fscanf(file, "P%c %u %u %u", &magic, &width, &height, &maxval) || '\n' != fgetc(file))
+		status = -1;
+	else if (width != image->width || height != image->height || magic != ((1 == image->channels) ? '5' : '6') || 255 != maxval)
+		status = -1;
+	else {
+		size_t size = (size_t) width * height * image->channels;
+		if (size != fread(image->pixels, 1, size, file))
+			status = -1;
+	}
+	fclose(file);
+
+	if (0 != status)
+		fprintf(stderr, "%s isn't a %ux%u reference image\n", path, image->width, image->height);
+	return status;
+};
+
+static void compare_images(const struct golden_image *expected, const struct golden_image *actual, unsigned int tolerance) {
+	size_t size = (size_t) actual->width * actual->height * actual->channels;
+	unsigned int max_error = 0;
+	unsigned long wrong_pixels = 0;
+
+	size_t pixel_idx;
+	unsigned int channel;
+	for (pixel_idx = 0; pixel_idx < size; pixel_idx += actual->channels) {
+		bool wrong = false;
+		for (channel = 0; channel < actual->channels; ++channel) {
+			unsigned int error = abs((int) expected->pixels[pixel_idx + channel] - (int) actual->pixels[pixel_idx + channel]);
+			if (error > max_error)
+				max_error = error;
+			wrong |= error > tolerance;
+		}
+		wrong_pixels += wrong;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s vs reference", actual->name);
+	printf("%-40s %s  (max error %u, %lu pixels off by more than %u)\n", name, wrong_pixels ? "FAIL" : "ok  ", max_error, wrong_pixels, tolerance);
+	if (wrong_pixels)
+		failures++;
+};
+
+static void pixels_to_rgb(const struct pixel_buffer *buffer, struct golden_image *image) {
+	size_t pixel_idx;
+	for (pixel_idx = 0; pixel_idx < (size_t) buffer->width * buffer->height; ++pixel_idx) {
+		Uint32 pixel = buffer->pixels[pixel_idx];
+		image->pixels[3 * pixel_idx] = (pixel >> 16) & 0xFF;
+		image->pixels[3 * pixel_idx + 1] = (pixel >> 8) & 0xFF;
+		image->pixels[3 * pixel_idx + 2] = pixel & 0xFF;
+	}
+};
+
+/*
+ * Reference images
+ */
+
+static void render_noise_image(struct golden_image *image, unsigned int step) {
+	// The same mapping as perlin's draw_noise
+	struct elevation_map lattice = {
+		.width = image->width,
+		.height = image->height,
+		.step = step,
+		.lattice_seed = GOLDEN_SEED,
+	};
+	create_noise_vectors(&lattice);
+
+	float *row_noise = (float*) malloc(image->width * sizeof(float));
+	unsigned int x, y;
+	for (y = 0; y < image->height; ++y) {
+		get_map_row_noise(&lattice, 0, y, image->width, row_noise);
+		for (x = 0; x < image->width; ++x)
+			image->pixels[y * image->width + x] = (Uint8) (unsigned int) (128 + row_noise[x] * 128);
+	}
+	free(row_noise);
+	free_elevation_map(&lattice);
+};
+
+static void render_volume_image(struct golden_image *image, float time) {
+	struct noise_volume volume = {
+		.width = image->width,
+		.height = image->height,
+		.step = 40,
+		.period = 4,
+		.lattice_seed = GOLDEN_SEED,
+	};
+	create_noise_volume(&volume);
+
+	float *row_noise = (float*) malloc(image->width * sizeof(float));
+	unsigned int x, y;
+	for (y = 0; y < image->height; ++y) {
+		get_volume_row_noise(&volume, 0, y, time, image->width, row_noise);
+		for (x = 0; x < image->width; ++x) {
+			float value = 128 + row_noise[x] * 256;
+			image->pixels[y * image->width + x] = (Uint8) ((value < 0) ? 0 : (value > 255) ? 255 : value);
+		}
+	}
+	free(row_noise);
+	free_noise_volume(&volume);
+};
+
+static void render_terrain_image(struct golden_image *image, const struct elevation_map *map, unsigned int threads, unsigned int depth, const struct vector *camera) {
+	struct terrain_renderer renderer;
+	init_terrain_renderer(&renderer, threads, image->width, depth);
+	struct pixel_buffer target = {
+		.width = image->width,
+		.height = image->height,
+		.pixels = (Uint32*) malloc((size_t) image->width * image->height * sizeof(Uint32)),
+	};
+
+	render_terrain(&renderer, &target, map, camera);
+	pixels_to_rgb(&target, image);
+
+	free(target.pixels);
+	free_terrain_renderer(&renderer);
+};
+
+static void render_top_down_image(struct golden_image *image, const struct elevation_map *map, const struct vector *camera) {
+	struct pixel_buffer target = {
+		.width = image->width,
+		.height = image->height,
+		.pixels = (Uint32*) malloc((size_t) image->width * image->height * sizeof(Uint32)),
+	};
+	render_top_down_map(&target, map, camera);
+	pixels_to_rgb(&target, image);
+	free(target.pixels);
+};
+
+static SDL_Surface *draw_plasma(unsigned int tick) {
+	// Where plasma's sin points are after this many ticks, see record_plasma
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, GOLDEN_PLASMA_WIDTH, GOLDEN_PLASMA_HEIGHT, 8, SDL_PIXELFORMAT_INDEX8);
+	prepare_palette(surface->format->palette, tick);
+	draw_plasma_to_surface(surface, 4 * tick, -2 * (int) tick, 4 * tick, -2 * (int) tick);
+	return surface;
+};
+
+static void render_plasma_image(struct golden_image *image) {
+	SDL_Surface *surface = draw_plasma(GOLDEN_PLASMA_TICK);
+	const SDL_Color *colours = surface->format->palette->colors;
+	unsigned int x, y;
+	for (y = 0; y < image->height; ++y)
+		for (x = 0; x < image->width; ++x) {
+			SDL_Color colour = colours[((const Uint8*) surface->pixels)[y * surface->pitch + x]];
+			Uint8 *pixel = image->pixels + 3 * ((size_t) y * image->width + x);
+			pixel[0] = colour.r;
+			pixel[1] = colour.g;
+			pixel[2] = colour.b;
+		}
+	SDL_FreeSurface(surface);
+};
+
+/*
+ * Cross-checks
+ */
+
+static int plasma_sin(int t) {
+	t = ((t % SIN_INDICES) + SIN_INDICES) % SIN_INDICES;
+	return (int) (SIN_AMPLITUDE * sin(2 * M_PI * t / SIN_INDICES));
+};
+
+static void check_plasma(void) {
+	// The sin table and the running indices against sin() at every pixel
+	unsigned int max_error = 0;
+	unsigned int tick, x, y;
+	for (tick = 0; tick < 1000; tick += 37) {
+		SDL_Surface *surface = draw_plasma(tick);
+		int p1 = 4 * tick, p2 = -2 * (int) tick, p3 = 4 * tick, p4 = -2 * (int) tick;
+		for (y = 0; y < surface->h; ++y)
+			for (x = 0; x < surface->w; ++x) {
+				int index = PLASMA_PEAK + plasma_sin(p1 + 2 * y) + plasma_sin(p2 + y) + plasma_sin(p3 + x) + plasma_sin(p4 + 2 * x);
+				// Indices wrap around the palette like draw_plasma_to_surface's do
+				int error = (((const Uint8*) surface->pixels)[y * surface->pitch + x] - index) & 0xFF;
+				error = (error > 128) ? 256 - error : error;
+				if (error > (int) max_error)
+					max_error = error;
+			}
+		SDL_FreeSurface(surface);
+	}
+	report_check("plasma", 0 == max_error, "max error %g", max_error);
+};
+
+static void check_noise_kernels(void) {
+	// Each kernel, point and row, against the original formula
+	static const unsigned int steps[] = { 25, 50, 80, 100, 64, 16, 30 };
+	unsigned int step_idx, kernel_idx, x, y;
+
+	for (step_idx = 0; step_idx < sizeof(steps) / sizeof(steps[0]); ++step_idx) {
+		struct elevation_map map = {
+			.width = 7 * steps[step_idx],
+			.height = 4 * steps[step_idx],
+			.step = steps[step_idx],
+			.lattice_seed = GOLDEN_SEED,
+		};
+		create_noise_vectors(&map);
+		float *row = (float*) malloc(map.width * sizeof(float));
+		float *gradient_row = (float*) malloc(map.width * sizeof(float));
+		struct vector *gradients = (struct vector*) malloc(map.width * sizeof(struct vector));
+
+		for (kernel_idx = 0; kernel_idx < noise_kernel_count; ++kernel_idx) {
+			const struct noise_kernel *kernel = &noise_kernels[kernel_idx];
+			if (!noise_kernel_supports(kernel, map.step))
+				continue;
+
+			double max_error = 0., max_slope_error = 0.;
+			for (y = 0; y < map.height; ++y) {
+				kernel->row(&map, 0, y, map.width, row);
+				kernel->row_gradients(&map, 0, y, map.width, gradient_row, gradients);
+				for (x = 0; x < map.width; ++x) {
+					double reference = reference_map_noise(&map, x, y);
+					max_error = fmax(max_error, fabs(row[x] - reference));
+					max_error = fmax(max_error, fabs(gradient_row[x] - reference));
+					max_error = fmax(max_error, fabs(kernel->point(&map, x, y) - reference));
+
+					// Central differences, away from the edges of cells
+					if (0 == x % map.step || 0 == y % map.step || x + 1 >= map.width || y + 1 >= map.height)
+						continue;
+					double slope_x = (reference_map_noise(&map, x + 1, y) - reference_map_noise(&map, x - 1, y)) / 2;
+					double slope_y = (reference_map_noise(&map, x, y + 1) - reference_map_noise(&map, x, y - 1)) / 2;
+					max_slope_error = fmax(max_slope_error, fabs(gradients[x].x - slope_x));
+					max_slope_error = fmax(max_slope_error, fabs(gradients[x].y - slope_y));
+				}
+			}
+
+			char name[64];
+			snprintf(name, sizeof(name), "%s kernel at step %u", kernel->name, map.step);
+			report_check(name, max_error <= GOLDEN_NOISE_EPSILON, "max error %g", max_error);
+			snprintf(name, sizeof(name), "%s gradients at step %u", kernel->name, map.step);
+			report_check(name, max_slope_error <= GOLDEN_SLOPE_EPSILON(map.step), "max error %g", max_slope_error);
+		}
+
+		free(row);
+		free(gradient_row);
+		free(gradients);
+		free_elevation_map(&map);
+	}
+};
+
+static void check_elevation_sampling(const struct elevation_map *map) {
+	// The cache, and sampling it at whole coordinates, against get_map_elevation
+	float xs[256], ys[256], sampled[256];
+	double max_error = 0.;
+	unsigned int sample_idx, y;
+
+	for (y = 0; y < map->height; y += 7) {
+		for (sample_idx = 0; sample_idx < 256; ++sample_idx) {
+			xs[sample_idx] = (sample_idx * 13 + y) % map->width;
+			ys[sample_idx] = y;
+		}
+		sample_elevations(map, 256, xs, ys, sampled);
+		for (sample_idx = 0; sample_idx < 256; ++sample_idx) {
+			double reference = get_map_elevation(map, xs[sample_idx], y);
+			max_error = fmax(max_error, fabs(sampled[sample_idx] - reference));
+			max_error = fmax(max_error, fabs(map->elevations[(size_t) y * map->width + (unsigned int) xs[sample_idx]] - reference));
+		}
+	}
+	report_check("cached and sampled elevations", max_error <= GOLDEN_NOISE_EPSILON, "max error %g", max_error);
+};
+
+static void check_volume_kernel(void) {
+	struct noise_volume volume = {
+		.width = 400,
+		.height = 240,
+		.step = 40,
+		.period = 4,
+		.lattice_seed = GOLDEN_SEED,
+	};
+	create_noise_volume(&volume);
+
+	float row[400];
+	double max_error = 0.;
+	float time;
+	unsigned int x, y;
+	for (time = 0; time < 200; time += 23.3)
+		for (y = 0; y < volume.height; y += 3) {
+			get_volume_row_noise(&volume, 0, y, time, volume.width, row);
+			for (x = 0; x < volume.width; ++x)
+				max_error = fmax(max_error, fabs(row[x] - get_volume_noise(&volume, x, y, time)));
+		}
+	report_check("volume row kernel", max_error <= GOLDEN_NOISE_EPSILON, "max error %g", max_error);
+	free_noise_volume(&volume);
+};
+
+static void check_ramp_lut(struct colour_ramp *ramp) {
+	unsigned int max_error = 0;
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx <= 100000; ++sample_idx) {
+		float elevation = sample_idx / 100000.;
+		SDL_Color colour;
+		elevation_to_colour(elevation, ramp, &colour);
+		Uint32 pixel = elevation_to_pixel(ramp, elevation);
+
+		int errors[3] = {
+			abs((int) ((pixel >> 16) & 0xFF) - colour.r),
+			abs((int) ((pixel >> 8) & 0xFF) - colour.g),
+			abs((int) (pixel & 0xFF) - colour.b),
+		};
+		unsigned int channel;
+		for (channel = 0; channel < 3; ++channel)
+			if (errors[channel] > (int) max_error)
+				max_error = errors[channel];
+	}
+	report_check("ramp LUT", max_error <= 1, "max error %g", max_error);
+};
+
+static void check_threaded_terrain(const struct elevation_map *map, unsigned int depth, const struct vector *camera) {
+	// Splitting the work between threads must not change a single pixel
+	struct golden_image single = new_image("terrain_single", GOLDEN_FRAME_WIDTH, GOLDEN_FRAME_HEIGHT, 3);
+	struct golden_image threaded = new_image("terrain_threaded", GOLDEN_FRAME_WIDTH, GOLDEN_FRAME_HEIGHT, 3);
+	render_terrain_image(&single, map, 0, depth, camera);
+	render_terrain_image(&threaded, map, GOLDEN_THREADS, depth, camera);
+
+	size_t size = (size_t) single.width * single.height * 3;
+	unsigned long differences = 0;
+	size_t byte_idx;
+	for (byte_idx = 0; byte_idx < size; ++byte_idx)
+		differences += single.pixels[byte_idx] != threaded.pixels[byte_idx];
+	report_check("threaded terrain", 0 == differences, "%g bytes differ", differences);
+
+	free(single.pixels);
+	free(threaded.pixels);
+};
+
+int main(int argc, char **argv) {
+	if (argc < 3 || (0 != strcmp(argv[1], "record") && 0 != strcmp(argv[1], "check"))) {
+		fprintf(stderr, "usage: %s record|check DIRECTORY [-t TOLERANCE]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const bool recording = 0 == strcmp(argv[1], "record");
+	const char *directory = argv[2];
+	unsigned int tolerance = GOLDEN_TOLERANCE;
+	if (argc > 4 && 0 == strcmp(argv[3], "-t"))
+		tolerance = atoi(argv[4]);
+
+	// The terrain as terrain draws it without a config file
+	struct terrain_config config;
+	default_terrain_config(&config);
+	struct elevation_map map = {
+		.width = 2000,
+		.height = 2000,
+		.step = config.step,
+		.normalised_min = config.normalised_min,
+		.normalised_max = config.normalised_max,
+		.lattice_seed = GOLDEN_SEED,
+		.colour_ramp = &(struct colour_ramp) {
+			.min = 0.,
+			.max = 1.,
+			.gradients = NULL,
+		},
+	};
+	apply_ramp_config(map.colour_ramp, &config);
+	create_noise_vectors(&map);
+	cache_elevations(&map);
+	prepare_sin();
+
+	static const struct vector cameras[] = {
+		{ .x = 1000, .y = 1500 },
+		{ .x = 420.5, .y = 1800.25 },
+		{ .x = 1700.75, .y = 300.5 },
+	};
+
+	struct golden_image images[] = {
+		new_image("noise_25", 200, 200, 1),
+		new_image("noise_64", 256, 192, 1),
+		new_image("volume", 320, 200, 1),
+		new_image("terrain_0", GOLDEN_FRAME_WIDTH, GOLDEN_FRAME_HEIGHT, 3),
+		new_image("terrain_1", GOLDEN_FRAME_WIDTH, GOLDEN_FRAME_HEIGHT, 3),
+		new_image("terrain_2", GOLDEN_FRAME_WIDTH, GOLDEN_FRAME_HEIGHT, 3),
+		new_image("top_down", 200, 200, 3),
+		new_image("plasma", GOLDEN_PLASMA_WIDTH, GOLDEN_PLASMA_HEIGHT, 3),
+	};
+	const unsigned int image_count = sizeof(images) / sizeof(images[0]);
+
+	render_noise_image(&images[0], 25);
+	render_noise_image(&images[1], 64);
+	render_volume_image(&images[2], 37.5);
+	unsigned int camera_idx;
+	for (camera_idx = 0; camera_idx < 3; ++camera_idx)
+		render_terrain_image(&images[3 + camera_idx], &map, GOLDEN_THREADS, config.view_depth, &cameras[camera_idx]);
+	render_top_down_image(&images[6], &map, &cameras[0]);
+	render_plasma_image(&images[7]);
+
+	unsigned int image_idx;
+	for (image_idx = 0; image_idx < image_count; ++image_idx) {
+		if (recording) {
+			if (0 != write_image(directory, &images[image_idx]))
+				failures++;
+			continue;
+		}
+
+		struct golden_image expected = new_image(images[image_idx].name, images[image_idx].width, images[image_idx].height, images[image_idx].channels);
+		if (0 == read_image(directory, &expected))
+			compare_images(&expected, &images[image_idx], tolerance);
+		else
+			failures++;
+		free(expected.pixels);
+	}
+
+	check_noise_kernels();
+	check_elevation_sampling(&map);
+	check_volume_kernel();
+	check_ramp_lut(map.colour_ramp);
+	check_plasma();
+	check_threaded_terrain(&map, config.view_depth, &cameras[1]);
+
+	for (image_idx = 0; image_idx < image_count; ++image_idx)
+		free(images[image_idx].pixels);
+	free_elevation_map(&map);
+	free_colour_ramp(map.colour_ramp);
+
+	if (failures)
+		printf("%u failures\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+static struct arena_block *new_arena_block(struct arena_block *previous, size_t size) {
+	struct arena_block *block = (struct arena_block*) malloc(sizeof(struct arena_block) + size);
+	if (!block)
+		return NULL;
+	block->previous = previous;
+	block->size = size;
+	block->used = 0;
+	return block;
+};
+
+void *arena_alloc(struct arena *arena, size_t size) {
+	struct arena_block *block = arena->current;
+	if (block) {
+		uintptr_t start = (uintptr_t) (block->memory + block->used);
+		size_t padding = (ARENA_ALIGNMENT - start % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+		if (padding + size <= block->size - block->used) {
+			block->used += padding + size;
+			return (void*) (start + padding);
+		}
+	}
+
+	// Doesn't fit, start a new block big enough for it
+	size_t block_size = arena->block_size ? arena->block_size : ARENA_BLOCK_SIZE;
+	if (block_size < size + ARENA_ALIGNMENT)
+		block_size = size + ARENA_ALIGNMENT;
+	block = new_arena_block(arena->current, block_size);
+	if (!block)
+		return NULL;
+	arena->current = block;
+	return arena_alloc(arena, size);
+};
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size) {
+	void *memory = arena_alloc(arena, count * size);
+	if (memory)
+		memset(memory, 0, count * size);
+	return memory;
+};
+
+void reset_arena(struct arena *arena) {
+	/*
+	 * With a single block this is just forgetting about its contents.
+	 * Otherwise, the blocks are merged into one that's big enough for
+	 * everything they held, so that the next time round it's just one block
+	 * again.
+	 */
+	struct arena_block *block = arena->current;
+	if (!block)
+		return;
+	if (!block->previous) {
+		block->used = 0;
+		return;
+	}
+
+	size_t total_size = 0;
+	while (block) {
+		struct arena_block *previous = block->previous;
+		total_size += block->size;
+		free(block);
+		block = previous;
+	}
+	arena->current = new_arena_block(NULL, total_size);
+};
+
+void free_arena(struct arena *arena) {
+	struct arena_block *block = arena->current;
+	while (block) {
+		struct arena_block *previous = block->previous;
+		free(block);
+		block = previous;
+	}
+	arena->current = NULL;
+};
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Allocations are aligned for anything up to SSE/NEON vectors
+#define ARENA_ALIGNMENT		16
+#define ARENA_BLOCK_SIZE	(64 * 1024)
+
+struct arena_block {
+	struct arena_block *previous;
+	size_t size;
+	size_t used;
+	unsigned char memory[];
+};
+
+/*
+ * Memory that's all released at once. Allocating is bumping a pointer, and
+ * resetting the arena makes all of its memory available again without
+ * handing anything back to malloc, so that code that runs every frame can
+ * have scratch space without ever calling malloc once things have warmed
+ * up.
+ *
+ * A zeroed arena is ready to use. Arenas aren't thread-safe, threads should
+ * have arenas of their own.
+ */
+struct arena {
+	struct arena_block *current;
+	// 0 means ARENA_BLOCK_SIZE
+	size_t block_size;
+};
+
+void *arena_alloc(struct arena*, size_t);
+
+void *arena_calloc(struct arena*, size_t, size_t);
+
+void reset_arena(struct arena*);
+
+void free_arena(struct arena*);
+
+#endif
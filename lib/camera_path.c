@@ -0,0 +1,135 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "camera_path.h"
+
+static float turn_between(float from, float to) {
+	// The shortest turn from one heading to the other, -pi to pi
+	float turn = fmodf(to - from, 2 * M_PI);
+	if (turn > M_PI)
+		turn -= 2 * M_PI;
+	if (turn < -M_PI)
+		turn += 2 * M_PI;
+	return turn;
+};
+
+static float heading_towards(const struct vector *from, const struct vector *to) {
+	// 0 is towards -y, pi/2 towards +x
+	return atan2f(to->x - from->x, from->y - to->y);
+};
+
+int load_camera_path(struct camera_path *path, const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return -1;
+	}
+
+	// Which waypoints face the next one rather than a heading of their own
+	bool facing_ahead[CAMERA_PATH_MAX_WAYPOINTS];
+
+	path->waypoint_count = 0;
+	int status = 0;
+	unsigned int line_number = 0;
+	char line[CAMERA_PATH_MAX_LINE];
+	while (0 == status && fgets(line, sizeof(line), file)) {
+		++line_number;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		// Blank lines are fine
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		struct waypoint *waypoint = &path->waypoints[path->waypoint_count];
+		float heading;
+		int fields = 0;
+		if (path->waypoint_count < CAMERA_PATH_MAX_WAYPOINTS)
+			fields = sscanf(
+				line,
+				"%f %f %f %f %f",
+				&waypoint->camera.position.x,
+				&waypoint->camera.position.y,
+				&waypoint->camera.altitude,
+				&waypoint->speed,
+				&heading
+			);
+		if (fields < 4 || waypoint->camera.altitude <= 0 || waypoint->speed <= 0) {
+			fprintf(stderr, "%s:%u: cannot make sense of this line\n", filename, line_number);
+			status = -1;
+			continue;
+		}
+
+		facing_ahead[path->waypoint_count] = (5 != fields);
+		waypoint->camera.heading = heading * M_PI / 180;
+		path->waypoint_count++;
+	}
+	fclose(file);
+
+	if (0 == status && path->waypoint_count < 2) {
+		fprintf(stderr, "%s: a path needs at least two waypoints\n", filename);
+		status = -1;
+	}
+	if (0 != status)
+		return status;
+
+	unsigned int waypoint_idx;
+	for (waypoint_idx = 0; waypoint_idx < path->waypoint_count; ++waypoint_idx) {
+		if (!facing_ahead[waypoint_idx])
+			continue;
+		const struct vector *here = &path->waypoints[waypoint_idx].camera.position;
+		if (waypoint_idx + 1 < path->waypoint_count)
+			path->waypoints[waypoint_idx].camera.heading = heading_towards(here, &path->waypoints[waypoint_idx + 1].camera.position);
+		else
+			path->waypoints[waypoint_idx].camera.heading = heading_towards(&path->waypoints[waypoint_idx - 1].camera.position, here);
+	}
+
+	path->segment = 0;
+	path->travelled = 0.;
+	return 0;
+};
+
+void start_camera_path(struct camera_path *path, struct camera_state *camera) {
+	path->segment = 0;
+	path->travelled = 0.;
+	*camera = path->waypoints[0].camera;
+};
+
+bool advance_camera_path(struct camera_path *path, float seconds, struct camera_state *camera) {
+	/*
+	 * Moves the camera on by however far it flies in that many seconds, and
+	 * returns false once it's reached the last waypoint. Whatever time's left
+	 * at the end of a segment is spent on the next one, at its own speed.
+	 */
+	while (path->segment + 1 < path->waypoint_count) {
+		const struct waypoint *from = &path->waypoints[path->segment];
+		const struct waypoint *to = &path->waypoints[path->segment + 1];
+		const float length = hypotf(
+			to->camera.position.x - from->camera.position.x,
+			to->camera.position.y - from->camera.position.y
+		);
+
+		const float remaining = length - path->travelled;
+		if (seconds * from->speed < remaining) {
+			path->travelled += seconds * from->speed;
+			interpolate_camera(&from->camera, &to->camera, path->travelled / length, camera);
+			return true;
+		}
+
+		seconds -= remaining / from->speed;
+		path->segment++;
+		path->travelled = 0.;
+	}
+
+	*camera = path->waypoints[path->waypoint_count - 1].camera;
+	return false;
+};
+
+void interpolate_camera(const struct camera_state *from, const struct camera_state *to, float weight, struct camera_state *camera) {
+	// Headings turn the short way round
+	camera->position.x = from->position.x + weight * (to->position.x - from->position.x);
+	camera->position.y = from->position.y + weight * (to->position.y - from->position.y);
+	camera->altitude = from->altitude + weight * (to->altitude - from->altitude);
+	camera->heading = from->heading + weight * turn_between(from->heading, to->heading);
+};
@@ -0,0 +1,54 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <stdbool.h>
+
+#include "noise.h"
+
+#define CAMERA_PATH_MAX_WAYPOINTS	256
+#define CAMERA_PATH_MAX_LINE		256
+
+// Where the camera is, which way it's facing and how high it's flying
+struct camera_state {
+	struct vector position;
+	// Radians clockwise from north, see the renderer's heading
+	float heading;
+	float altitude;
+};
+
+struct waypoint {
+	struct camera_state camera;
+	// Map units per second, from this waypoint to the next
+	float speed;
+};
+
+/*
+ * A scripted flight from waypoint to waypoint. A path file has one waypoint
+ * per line, # starts a comment:
+ *
+ *   # x y altitude speed [heading]
+ *   1000 1500 120 30
+ *   1000 1200 150 60 45
+ *
+ * Headings are in degrees clockwise from north. A waypoint without one faces
+ * the next waypoint (the last one faces the way it came in). In between
+ * waypoints, the camera moves in a straight line at the first one's speed,
+ * and its altitude and heading change steadily from one to the other.
+ */
+struct camera_path {
+	unsigned int waypoint_count;
+	struct waypoint waypoints[CAMERA_PATH_MAX_WAYPOINTS];
+	// How far along the path the camera is
+	unsigned int segment;
+	float travelled;
+};
+
+int load_camera_path(struct camera_path*, const char*);
+
+void start_camera_path(struct camera_path*, struct camera_state*);
+
+bool advance_camera_path(struct camera_path*, float, struct camera_state*);
+
+void interpolate_camera(const struct camera_state*, const struct camera_state*, float, struct camera_state*);
+
+#endif
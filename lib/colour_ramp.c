@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "colour_ramp.h"
+#include "noise.h"
+
+inline SDL_Color hex_to_colour(unsigned int hex) {
+	return (SDL_Color) {
+			.r=(hex & 0xFF0000) >> 16,
+			.g=(hex & 0x00FF00) >> 8,
+			.b=(hex & 0x0000FF),
+			.a=0x00,
+	};
+};
+
+void push_gradient(struct colour_ramp *ramp, float gradient_max, SDL_Color hex_colour) {
+	assert(gradient_max > ramp->min);
+	assert(gradient_max < ramp->max);
+
+	struct ramp_gradient *new_gradient = arena_alloc(&ramp->arena, sizeof(struct ramp_gradient));
+	*new_gradient = (struct ramp_gradient) {
+		.max = gradient_max,
+		.colour = hex_colour,
+		.next = NULL,
+	};
+
+	struct ramp_gradient *previous, *current;
+	previous = current = ramp->gradients;
+	while (current) {
+		if (current->max > new_gradient->max)
+			break;
+		previous = current;
+		current = current->next;
+	};
+	new_gradient->next = current;
+
+	if (previous)
+		previous->next = new_gradient;
+	else
+		ramp->gradients = new_gradient;
+};
+
+void clear_gradients(struct colour_ramp *ramp) {
+	// Their memory is reused by the next push_gradient calls
+	reset_arena(&ramp->arena);
+	ramp->gradients = NULL;
+};
+
+void free_colour_ramp(struct colour_ramp *ramp) {
+	// The ramp itself belongs to the caller, its gradients don't
+	free_arena(&ramp->arena);
+	ramp->gradients = NULL;
+};
+
+void elevation_to_colour(float elevation, struct colour_ramp *ramp, SDL_Color *colour) {
+	/*
+	 * It is assumed that the list of gradients is sorted!
+	 */
+	SDL_Color *bottom_colour, *top_colour;
+	float min, max;
+	bottom_colour = &ramp->min_colour;
+	min = ramp->min;
+
+	struct ramp_gradient *current = ramp->gradients;
+	while (current) {
+		if (elevation <= current->max)
+			break;
+		min = current->max;
+		bottom_colour = &current->colour;
+		current = current->next;
+	};
+
+	if (current) {
+		max = current->max;
+		top_colour = &current->colour;
+	} else {
+		max = ramp->max;
+		top_colour = &ramp->max_colour;
+	};
+
+	// Normalise the elevation relative to the elevation_gradient
+	float normalised = (elevation - min) / (max - min);
+	float interpolation_factor = increasing_interpolant(normalised);
+
+	colour->r = bottom_colour->r * (1 - interpolation_factor) + top_colour->r * interpolation_factor;
+	colour->g = bottom_colour->g * (1 - interpolation_factor) + top_colour->g * interpolation_factor;
+	colour->b = bottom_colour->b * (1 - interpolation_factor) + top_colour->b * interpolation_factor;
+	colour->a = SDL_ALPHA_OPAQUE;
+};
+
+Uint32 colour_to_pixel(SDL_Color colour) {
+	// Pixel buffers are always ARGB8888
+	return 0xFF000000 | (colour.r << 16) | (colour.g << 8) | colour.b;
+};
+
+void build_ramp_lut(struct colour_ramp *ramp) {
+	SDL_Color colour;
+	unsigned int lut_idx;
+	for (lut_idx = 0; lut_idx < RAMP_LUT_SIZE; ++lut_idx) {
+		float elevation = ramp->min + (ramp->max - ramp->min) * lut_idx / (RAMP_LUT_SIZE - 1);
+		elevation_to_colour(elevation, ramp, &colour);
+		ramp->lut[lut_idx] = colour_to_pixel(colour);
+	}
+};
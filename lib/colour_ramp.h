@@ -0,0 +1,81 @@
+#ifndef COLOUR_RAMP_H
+#define COLOUR_RAMP_H
+
+#include "SDL.h"
+
+#include "arena.h"
+
+#define RAMP_LUT_SIZE	4096
+
+struct ramp_gradient {
+	float max;
+	SDL_Color colour;
+	struct ramp_gradient *next;
+};
+
+/*
+ * Maps elevations between min and max to colours, going through the
+ * colour of each gradient stop in turn
+ */
+struct colour_ramp {
+	float min;
+	float max;
+	SDL_Color min_colour;
+	SDL_Color max_colour;
+	struct ramp_gradient *gradients;
+	// Where the gradients live, see free_colour_ramp
+	struct arena arena;
+	// Pixels for RAMP_LUT_SIZE evenly spaced elevations, see build_ramp_lut
+	Uint32 lut[RAMP_LUT_SIZE];
+};
+
+SDL_Color hex_to_colour(unsigned int);
+
+Uint32 colour_to_pixel(SDL_Color);
+
+void push_gradient(struct colour_ramp*, float, SDL_Color);
+
+void clear_gradients(struct colour_ramp*);
+
+void free_colour_ramp(struct colour_ramp*);
+
+void elevation_to_colour(float, struct colour_ramp*, SDL_Color*);
+
+void build_ramp_lut(struct colour_ramp*);
+
+static inline Uint32 elevation_to_pixel(const struct colour_ramp *ramp, float elevation) {
+	/*
+	 * Must only be called once build_ramp_lut has been called after the last
+	 * change to the ramp
+	 */
+	int lut_idx = (int) ((elevation - ramp->min) / (ramp->max - ramp->min) * (RAMP_LUT_SIZE - 1) + .5);
+	if (lut_idx < 0)
+		lut_idx = 0;
+	if (lut_idx > RAMP_LUT_SIZE - 1)
+		lut_idx = RAMP_LUT_SIZE - 1;
+	return ramp->lut[lut_idx];
+};
+
+static inline Uint32 blend_pixels(Uint32 pixel, Uint32 other, unsigned int weight) {
+	/*
+	 * weight/256 of the way from pixel to other, for 0 <= weight <= 256.
+	 * Red and blue are blended together, they can't overflow into each
+	 * other.
+	 */
+	Uint32 red_blue = ((pixel & 0xFF00FF) * (256 - weight) + (other & 0xFF00FF) * weight) >> 8;
+	Uint32 green = ((pixel & 0xFF00) * (256 - weight) + (other & 0xFF00) * weight) >> 8;
+	return 0xFF000000 | (red_blue & 0xFF00FF) | (green & 0xFF00);
+};
+
+static inline Uint32 shade_pixel(Uint32 pixel, float intensity) {
+	// Scales an ARGB pixel's channels, saturating rather than wrapping
+	float r = ((pixel >> 16) & 0xFF) * intensity;
+	float g = ((pixel >> 8) & 0xFF) * intensity;
+	float b = (pixel & 0xFF) * intensity;
+	r = (r > 255) ? 255 : r;
+	g = (g > 255) ? 255 : g;
+	b = (b > 255) ? 255 : b;
+	return (pixel & 0xFF000000) | ((Uint32) r << 16) | ((Uint32) g << 8) | (Uint32) b;
+};
+
+#endif
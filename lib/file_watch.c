@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "file_watch.h"
+
+#ifdef __linux__
+
+bool start_file_watch(struct file_watch *watch, const char *path) {
+	watch->path = path;
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0)
+		return false;
+
+	// The directory's watched rather than the file, and events are filtered
+	const char *slash = strrchr(path, '/');
+	size_t directory_length = slash ? (size_t) (slash - path + 1) : 1;
+	char *directory = (char*) malloc(directory_length + 1);
+	memcpy(directory, slash ? path : ".", directory_length);
+	directory[directory_length] = '\0';
+	watch->name = slash ? slash + 1 : path;
+
+	int watched = inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+	free(directory);
+	if (watched < 0) {
+		close(watch->fd);
+		watch->fd = -1;
+		return false;
+	}
+	return true;
+};
+
+bool file_changed(struct file_watch *watch) {
+	// Drains every pending event, several of them usually come at once
+	bool changed = false;
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+	while (watch->fd >= 0 && (length = read(watch->fd, events, sizeof(events))) > 0) {
+		const char *cursor = events;
+		while (cursor < events + length) {
+			const struct inotify_event *event = (const struct inotify_event*) cursor;
+			if (event->len && 0 == strcmp(event->name, watch->name))
+				changed = true;
+			cursor += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return changed;
+};
+
+void stop_file_watch(struct file_watch *watch) {
+	if (watch->fd >= 0)
+		close(watch->fd);
+	watch->fd = -1;
+};
+
+#else
+
+static time_t modification_time(const char *path) {
+	struct stat status;
+	return (0 == stat(path, &status)) ? status.st_mtime : 0;
+};
+
+bool start_file_watch(struct file_watch *watch, const char *path) {
+	watch->path = path;
+	watch->fd = -1;
+	watch->modified = modification_time(path);
+	return true;
+};
+
+bool file_changed(struct file_watch *watch) {
+	time_t modified = modification_time(watch->path);
+	if (modified == watch->modified)
+		return false;
+	watch->modified = modified;
+	return true;
+};
+
+void stop_file_watch(struct file_watch *watch) {
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * Tells when a file's been written to. On Linux this is inotify on the
+ * file's directory, which also catches editors that save by writing a new
+ * file and renaming it over the old one. Elsewhere, it compares the file's
+ * modification time every time it's asked.
+ */
+struct file_watch {
+	const char *path;
+	// inotify
+	int fd;
+	const char *name;
+	// Everywhere else
+	time_t modified;
+};
+
+bool start_file_watch(struct file_watch*, const char*);
+
+bool file_changed(struct file_watch*);
+
+void stop_file_watch(struct file_watch*);
+
+#endif
@@ -0,0 +1,93 @@
+#include <math.h>
+
+#include "frame_clock.h"
+
+void frame_clock_init(struct frame_clock *clock, unsigned int tick_rate, int refresh_rate) {
+	if (refresh_rate <= 0)
+		refresh_rate = FRAME_CLOCK_DEFAULT_REFRESH;
+
+	*clock = (struct frame_clock) {
+		.frequency = SDL_GetPerformanceFrequency(),
+		.previous = SDL_GetPerformanceCounter(),
+		.tick = 1. / tick_rate,
+		.frame_budget = 1. / refresh_rate,
+		.accumulator = 0.,
+	};
+};
+
+void frame_clock_record(struct frame_clock *clock, double frame_time) {
+	clock->total_frame_time += frame_time;
+	if (frame_time > clock->worst_frame_time)
+		clock->worst_frame_time = frame_time;
+	if (frame_time > FRAME_CLOCK_MISSED_FACTOR * clock->frame_budget)
+		clock->missed_deadlines++;
+
+	double jitter_ms = 1000. * fabs(frame_time - clock->frame_budget);
+	double bucket_max = .5;
+	unsigned int bucket;
+	for (bucket = 0; bucket < FRAME_CLOCK_JITTER_BUCKETS - 1; ++bucket) {
+		if (jitter_ms < bucket_max)
+			break;
+		bucket_max *= 2;
+	}
+	clock->jitter[bucket]++;
+};
+
+/*
+ * Call once per frame. Returns the number of simulation ticks to run before
+ * rendering the frame.
+ */
+unsigned int frame_clock_advance(struct frame_clock *clock) {
+	Uint64 now = SDL_GetPerformanceCounter();
+	double frame_time = (double) (now - clock->previous) / clock->frequency;
+	clock->previous = now;
+
+	// The first frame's duration is just start-up noise
+	if (clock->frames++)
+		frame_clock_record(clock, frame_time);
+
+	clock->accumulator += frame_time;
+	unsigned int ticks = (unsigned int) (clock->accumulator / clock->tick);
+	clock->accumulator -= ticks * clock->tick;
+
+	if (ticks > FRAME_CLOCK_MAX_TICKS) {
+		clock->dropped_ticks += ticks - FRAME_CLOCK_MAX_TICKS;
+		ticks = FRAME_CLOCK_MAX_TICKS;
+	}
+	clock->ticks += ticks;
+	return ticks;
+};
+
+/*
+ * How far we are between the last simulation tick and the next one,
+ * 0 <= alpha < 1
+ */
+float frame_clock_alpha(const struct frame_clock *clock) {
+	return clock->accumulator / clock->tick;
+};
+
+void frame_clock_report(const struct frame_clock *clock, FILE *output) {
+	if (clock->frames < 2)
+		return;
+
+	const unsigned long measured = clock->frames - 1;
+	fprintf(output, "%lu frames, %lu ticks (%lu dropped)\n", clock->frames, clock->ticks, clock->dropped_ticks);
+	fprintf(output, "Frame time: %.2fms mean, %.2fms worst, %.2fms budget\n",
+		1000. * clock->total_frame_time / measured,
+		1000. * clock->worst_frame_time,
+		1000. * clock->frame_budget
+	);
+	fprintf(output, "Missed deadlines: %lu (%.1f%%)\n", clock->missed_deadlines, 100. * clock->missed_deadlines / measured);
+
+	fprintf(output, "Jitter against the frame budget:\n");
+	double bucket_min = 0., bucket_max = .5;
+	unsigned int bucket;
+	for (bucket = 0; bucket < FRAME_CLOCK_JITTER_BUCKETS; ++bucket) {
+		if (bucket < FRAME_CLOCK_JITTER_BUCKETS - 1)
+			fprintf(output, "  %5.1f - %5.1fms: %lu\n", bucket_min, bucket_max, clock->jitter[bucket]);
+		else
+			fprintf(output, "  %5.1fms and up: %lu\n", bucket_min, clock->jitter[bucket]);
+		bucket_min = bucket_max;
+		bucket_max *= 2;
+	}
+};
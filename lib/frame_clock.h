@@ -0,0 +1,54 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "SDL.h"
+
+// If we've fallen this far behind, there's no catching up
+#define FRAME_CLOCK_MAX_TICKS		8
+
+// A frame that takes this many frame budgets has missed its vsync
+#define FRAME_CLOCK_MISSED_FACTOR	1.5
+
+#define FRAME_CLOCK_DEFAULT_REFRESH	60
+
+// Jitter buckets are 0.5ms wide, then double in width
+#define FRAME_CLOCK_JITTER_BUCKETS	8
+
+/*
+ * The simulation (animation, camera motion, ...) advances in fixed ticks
+ * regardless of how long frames take to render and present. Every frame
+ * consumes however many ticks have elapsed since the previous one and
+ * renders in between the last two simulation states, see
+ * frame_clock_alpha.
+ */
+struct frame_clock {
+	Uint64 frequency;
+	Uint64 previous;
+	double tick;
+	double frame_budget;
+	double accumulator;
+
+	// Frame pacing statistics
+	unsigned long frames;
+	unsigned long ticks;
+	unsigned long dropped_ticks;
+	unsigned long missed_deadlines;
+	double total_frame_time;
+	double worst_frame_time;
+	unsigned long jitter[FRAME_CLOCK_JITTER_BUCKETS];
+};
+
+void frame_clock_init(struct frame_clock*, unsigned int, int);
+
+void frame_clock_record(struct frame_clock*, double);
+
+unsigned int frame_clock_advance(struct frame_clock*);
+
+float frame_clock_alpha(const struct frame_clock*);
+
+void frame_clock_report(const struct frame_clock*, FILE*);
+
+#endif
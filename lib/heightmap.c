@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "heightmap.h"
+#include "thread_pool.h"
+
+void generate_heightmap_band(void *context, unsigned int band_idx) {
+	struct heightmap_band *band = &((struct heightmap_band*) context)[band_idx];
+	const unsigned int last_row = band->first_row + band->rows;
+
+	// Maps can be arbitrarily wide, this doesn't belong on the stack
+	reset_arena(&band->arena);
+	band->samples = (Uint8*) arena_alloc(&band->arena, (size_t) 2 * band->rows * band->map->width);
+	float *row_elevations = (float*) arena_alloc(&band->arena, band->map->width * sizeof(float));
+	Uint8 *sample = band->samples;
+	unsigned int map_x, map_y;
+	for (map_y = band->first_row; map_y < last_row; ++map_y) {
+		get_map_row_elevations(band->map, 0, map_y, band->map->width, row_elevations);
+
+		for (map_x = 0; map_x < band->map->width; ++map_x) {
+			Uint16 value = (Uint16) (row_elevations[map_x] * EXPORT_PGM_MAXVAL + .5);
+
+			// 16-bit PGM is big-endian, raw dumps are little-endian
+			if (HEIGHTMAP_PGM == band->format) {
+				sample[0] = value >> 8;
+				sample[1] = value & 0xFF;
+			} else {
+				sample[0] = value & 0xFF;
+				sample[1] = value >> 8;
+			}
+			sample += 2;
+		}
+	}
+};
+
+static int close_heightmap_tiles(FILE **tiles, unsigned int tile_count) {
+	int status = 0;
+	unsigned int tile_x;
+	for (tile_x = 0; tile_x < tile_count; ++tile_x) {
+		if (tiles[tile_x] && 0 != fclose(tiles[tile_x]))
+			status = -1;
+		tiles[tile_x] = NULL;
+	}
+	return status;
+};
+
+static int open_heightmap_tiles(const struct heightmap_export *export, FILE **tiles, unsigned int tile_y) {
+	const struct elevation_map *map = export->map;
+	const bool tiled = export->tile_width < map->width || export->tile_height < map->height;
+	const unsigned int tile_count = (map->width + export->tile_width - 1) / export->tile_width;
+	const unsigned int top = tile_y * export->tile_height;
+	const unsigned int height = (map->height - top < export->tile_height) ? map->height - top : export->tile_height;
+	const char *extension = (HEIGHTMAP_PGM == export->format) ? "pgm" : "raw";
+
+	unsigned int tile_x;
+	for (tile_x = 0; tile_x < tile_count; ++tile_x) {
+		const unsigned int left = tile_x * export->tile_width;
+		const unsigned int width = (map->width - left < export->tile_width) ? map->width - left : export->tile_width;
+
+		char path[FILENAME_MAX];
+		if (tiled)
+			snprintf(path, sizeof(path), "%s_%u_%u.%s", export->prefix, tile_x, tile_y, extension);
+		else
+			snprintf(path, sizeof(path), "%s.%s", export->prefix, extension);
+
+		tiles[tile_x] = fopen(path, "wb");
+		if (!tiles[tile_x]) {
+			fprintf(stderr, "Cannot open %s for writing\n", path);
+			return -1;
+		}
+
+		if (HEIGHTMAP_PGM == export->format)
+			fprintf(tiles[tile_x], "P5\n%u %u\n%u\n", width, height, EXPORT_PGM_MAXVAL);
+	}
+	return 0;
+};
+
+static int write_heightmap_band(const struct heightmap_export *export, const struct heightmap_band *band, FILE **tiles) {
+	const struct elevation_map *map = export->map;
+	const unsigned int tile_count = (map->width + export->tile_width - 1) / export->tile_width;
+
+	unsigned int band_row, tile_x;
+	for (band_row = 0; band_row < band->rows; ++band_row) {
+		const unsigned int map_y = band->first_row + band_row;
+
+		// Tiles are only ever open one row of tiles at a time
+		if (0 == map_y % export->tile_height) {
+			if (0 != close_heightmap_tiles(tiles, tile_count))
+				return -1;
+			if (0 != open_heightmap_tiles(export, tiles, map_y / export->tile_height))
+				return -1;
+		}
+
+		const Uint8 *row_samples = band->samples + (size_t) 2 * band_row * map->width;
+		for (tile_x = 0; tile_x < tile_count; ++tile_x) {
+			const unsigned int left = tile_x * export->tile_width;
+			const unsigned int width = (map->width - left < export->tile_width) ? map->width - left : export->tile_width;
+
+			if (width != fwrite(row_samples + 2 * left, 2, width, tiles[tile_x]))
+				return -1;
+		}
+	}
+	return 0;
+};
+
+int export_heightmap(const struct heightmap_export *export) {
+	/*
+	 * The map is generated one band of rows at a time and each band is
+	 * written out as soon as it's ready, so that memory usage only depends on
+	 * the width of the map, the height of a band and the number of threads.
+	 * Bands are generated in batches, one per thread of the pool counting this
+	 * one, and written back in order.
+	 */
+	const struct elevation_map *map = export->map;
+	const unsigned int tile_count = (map->width + export->tile_width - 1) / export->tile_width;
+
+	FILE **tiles = (FILE**) calloc(tile_count, sizeof(FILE*));
+	struct heightmap_band *bands = (struct heightmap_band*) calloc(
+		export->threads,
+		sizeof(struct heightmap_band)
+	);
+	struct thread_pool pool;
+	start_thread_pool(&pool, export->threads - 1);
+
+	unsigned int band_idx;
+	int status = 0;
+	unsigned int next_row = 0;
+	while (0 == status && next_row < map->height) {
+		unsigned int band_count;
+		for (band_count = 0; band_count < export->threads && next_row < map->height; ++band_count) {
+			struct heightmap_band *band = &bands[band_count];
+			band->map = map;
+			band->format = export->format;
+			band->first_row = next_row;
+			band->rows = (map->height - next_row < export->band_rows) ? map->height - next_row : export->band_rows;
+			next_row += band->rows;
+		}
+		run_on_thread_pool(&pool, generate_heightmap_band, bands, band_count);
+
+		for (band_idx = 0; band_idx < band_count && 0 == status; ++band_idx)
+			status = write_heightmap_band(export, &bands[band_idx], tiles);
+	}
+	stop_thread_pool(&pool);
+
+	if (0 != close_heightmap_tiles(tiles, tile_count))
+		status = -1;
+
+	for (band_idx = 0; band_idx < export->threads; ++band_idx)
+		free_arena(&bands[band_idx].arena);
+	free(bands);
+	free(tiles);
+	return status;
+};
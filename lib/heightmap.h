@@ -0,0 +1,44 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include "SDL.h"
+
+#include "arena.h"
+#include "noise.h"
+
+// Heightmap export defaults. A band is the unit of work handed to a thread
+#define EXPORT_BAND_ROWS	64
+#define EXPORT_PGM_MAXVAL	65535
+
+enum heightmap_format {
+	HEIGHTMAP_PGM,
+	HEIGHTMAP_RAW,
+};
+
+struct heightmap_export {
+	const struct elevation_map *map;
+	enum heightmap_format format;
+	const char *prefix;
+	// A tile dimension of 0 means "as wide/tall as the map"
+	unsigned int tile_width;
+	unsigned int tile_height;
+	unsigned int band_rows;
+	unsigned int threads;
+};
+
+struct heightmap_band {
+	const struct elevation_map *map;
+	enum heightmap_format format;
+	unsigned int first_row;
+	unsigned int rows;
+	// Two bytes per sample, already in the output byte order
+	Uint8 *samples;
+	// The samples and the band's scratch space, reused from band to band
+	struct arena arena;
+};
+
+void generate_heightmap_band(void*, unsigned int);
+
+int export_heightmap(const struct heightmap_export*);
+
+#endif
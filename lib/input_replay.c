@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "input_replay.h"
+
+int start_input_recording(struct input_recording *recording, const char *path, unsigned int seed) {
+	recording->file = fopen(path, "w");
+	if (!recording->file) {
+		fprintf(stderr, "Cannot open %s for writing\n", path);
+		return -1;
+	}
+	fprintf(recording->file, "seed %u\n# ticks controls\n", seed);
+	recording->run = (struct input_run) { .ticks = 0, .controls = 0 };
+	return 0;
+};
+
+void record_input(struct input_recording *recording, Uint32 controls) {
+	// One call per simulation tick
+	if (recording->run.ticks && controls != recording->run.controls) {
+		fprintf(recording->file, "%lu 0x%X\n", recording->run.ticks, recording->run.controls);
+		recording->run.ticks = 0;
+	}
+	recording->run.controls = controls;
+	recording->run.ticks++;
+};
+
+int stop_input_recording(struct input_recording *recording) {
+	if (recording->run.ticks)
+		fprintf(recording->file, "%lu 0x%X\n", recording->run.ticks, recording->run.controls);
+	return (0 == fclose(recording->file)) ? 0 : -1;
+};
+
+int load_input_replay(struct input_replay *replay, const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return -1;
+	}
+
+	*replay = (struct input_replay) { .runs = NULL };
+	unsigned int run_capacity = 0;
+	bool seed_seen = false;
+
+	int status = 0;
+	unsigned int line_number = 0;
+	char line[INPUT_REPLAY_MAX_LINE];
+	while (0 == status && fgets(line, sizeof(line), file)) {
+		++line_number;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		// The seed comes first
+		if (!seed_seen) {
+			if (1 != sscanf(line, " seed %u", &replay->seed))
+				status = -1;
+			seed_seen = true;
+		} else {
+			if (replay->run_count == run_capacity) {
+				run_capacity = run_capacity ? 2 * run_capacity : 64;
+				replay->runs = (struct input_run*) realloc(replay->runs, run_capacity * sizeof(struct input_run));
+			}
+			struct input_run *run = &replay->runs[replay->run_count];
+			if (2 != sscanf(line, "%lu %x", &run->ticks, &run->controls) || 0 == run->ticks)
+				status = -1;
+			else
+				replay->run_count++;
+		}
+
+		if (0 != status)
+			fprintf(stderr, "%s:%u: cannot make sense of this line\n", path, line_number);
+	}
+	fclose(file);
+
+	if (0 == status && !seed_seen) {
+		fprintf(stderr, "%s: no seed\n", path);
+		status = -1;
+	}
+	if (0 != status)
+		free_input_replay(replay);
+	return status;
+};
+
+bool replay_input(struct input_replay *replay, Uint32 *controls) {
+	// The next tick's controls, or false once the recording's run out
+	if (replay->run_idx == replay->run_count)
+		return false;
+
+	*controls = replay->runs[replay->run_idx].controls;
+	if (++replay->tick == replay->runs[replay->run_idx].ticks) {
+		replay->run_idx++;
+		replay->tick = 0;
+	}
+	return true;
+};
+
+void free_input_replay(struct input_replay *replay) {
+	free(replay->runs);
+	replay->runs = NULL;
+	replay->run_count = replay->run_idx = 0;
+};
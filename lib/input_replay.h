@@ -0,0 +1,54 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "SDL.h"
+
+#define INPUT_REPLAY_MAX_LINE	64
+
+/*
+ * Which controls were held down on every simulation tick, as a bit mask the
+ * caller defines, along with the seed the session started with. Replaying
+ * them at the same tick rate from the same seed goes through the exact same
+ * states. Files hold the seed, then one run of identical ticks per line:
+ *
+ *   seed 1718000000
+ *   # ticks controls
+ *   120 0x0
+ *   45 0x1
+ */
+struct input_run {
+	unsigned long ticks;
+	Uint32 controls;
+};
+
+struct input_recording {
+	FILE *file;
+	// The run so far, written out once the controls change
+	struct input_run run;
+};
+
+struct input_replay {
+	unsigned int seed;
+	unsigned int run_count;
+	struct input_run *runs;
+	// Where the replay is up to
+	unsigned int run_idx;
+	unsigned long tick;
+};
+
+int start_input_recording(struct input_recording*, const char*, unsigned int);
+
+void record_input(struct input_recording*, Uint32);
+
+int stop_input_recording(struct input_recording*);
+
+int load_input_replay(struct input_replay*, const char*);
+
+bool replay_input(struct input_replay*, Uint32*);
+
+void free_input_replay(struct input_replay*);
+
+#endif
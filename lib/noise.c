@@ -0,0 +1,553 @@
+#include <math.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "noise.h"
+
+float next_lattice_random(Uint32 *state) {
+	// xorshift32, uniform between 0 and 1
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return (float) (*state >> 8) / (1 << 24);
+};
+
+void random_unit_vector(struct vector *dest, Uint32 *random) {
+	// Without a generator of its own, the lattice comes from rand()
+	float angle = random
+		? next_lattice_random(random) * 2 * M_PI
+		: ((float) rand() * 2 * M_PI) / (RAND_MAX);
+	dest->x = cos(angle);
+	dest->y = sin(angle);
+};
+
+inline float increasing_interpolant(float x) {
+	// x=0 -> 0
+	// x=1 -> 1
+	// x=0.5 -> 0.5
+	return x * x * (3 - 2 * x);
+};
+
+inline float increasing_interpolant_slope(float x) {
+	// Derivative of the above, 0 at both ends
+	return 6 * x * (1 - x);
+};
+
+float dot_product(const struct vector *lhs, const struct vector *rhs) {
+	/*
+	 * For each vector, we have -1 <= x,y <= 1 (within a cell of the grid)
+	 * the product is 
+	 * -2 <= dot_product <= 2
+	 */
+	return (lhs->x * rhs->x) + (lhs->y * rhs->y);
+};
+
+float reference_map_noise(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
+	/*
+	 * This is the original, straightforward implementation. The kernels must
+	 * agree with it to within rounding.
+	 */
+	if (map_x >= map->width || map_y >= map->height)
+		return 0.;
+
+	const unsigned int nodes_per_row = map->nodes_per_row;
+	unsigned int segment_x, segment_y;
+
+	segment_y = map_y / map->step;
+	segment_x = map_x / map->step;
+
+	unsigned int vector_idx_above_left, vector_idx_above_right, vector_idx_below_left, vector_idx_below_right;
+	vector_idx_above_left = segment_y * nodes_per_row + segment_x;
+	vector_idx_above_right = segment_y * nodes_per_row + segment_x + 1;
+	vector_idx_below_left = (segment_y + 1) * nodes_per_row + segment_x;
+	vector_idx_below_right = (segment_y + 1) * nodes_per_row + segment_x + 1;
+
+	unsigned int node_above_y = segment_y * map->step;
+	unsigned int node_below_y = node_above_y + map->step;
+	unsigned int node_left_x = segment_x * map->step;
+	unsigned int node_right_x = node_left_x + map->step;
+
+	struct vector from_below_left = {
+		.x = ((float) map_x - node_left_x) / map->step,
+		.y = ((float) map_y - node_below_y) / map->step,
+	};
+
+	struct vector from_below_right = {
+		.x = ((float) map_x - node_right_x) / map->step,
+		.y = from_below_left.y,
+	};
+
+	struct vector from_above_left = {
+		.x = from_below_left.x,
+		.y = ((float) map_y - node_above_y) / map->step,
+	};
+
+	struct vector from_above_right = {
+		.x = from_below_right.x,
+		.y = from_above_left.y,
+	};
+
+	float s = dot_product(&map->node_vectors[vector_idx_below_left], &from_below_left);
+	float t = dot_product(&map->node_vectors[vector_idx_below_right], &from_below_right);
+	float u = dot_product(&map->node_vectors[vector_idx_above_left], &from_above_left);
+	float v = dot_product(&map->node_vectors[vector_idx_above_right], &from_above_right);
+
+	float bottom_pair_avg = (1 - increasing_interpolant(from_above_left.x)) * s + increasing_interpolant(from_above_left.x) * t;
+	float top_pair_avg = (1 - increasing_interpolant(from_above_left.x)) * u + increasing_interpolant(from_above_left.x) * v;
+	return (1 - increasing_interpolant(from_above_left.y)) * top_pair_avg + increasing_interpolant(from_above_left.y) * bottom_pair_avg;
+};
+
+static inline float cell_noise(const struct elevation_map *map, unsigned int segment_x, unsigned int segment_y, unsigned int offset_x, unsigned int offset_y) {
+	/*
+	 * Noise at an offset from the top-left node of a cell. The normalised
+	 * offsets and their fade weights come from the map's tables.
+	 */
+	const struct vector *above = &map->node_vectors[segment_y * map->nodes_per_row + segment_x];
+	const struct vector *below = above + map->nodes_per_row;
+	const float from_left = map->cell_offsets[offset_x];
+	const float from_above = map->cell_offsets[offset_y];
+
+	float s = below[0].x * from_left + below[0].y * (from_above - 1);
+	float t = below[1].x * (from_left - 1) + below[1].y * (from_above - 1);
+	float u = above[0].x * from_left + above[0].y * from_above;
+	float v = above[1].x * (from_left - 1) + above[1].y * from_above;
+
+	float weight_x = map->fade_weights[offset_x];
+	float weight_y = map->fade_weights[offset_y];
+	float bottom_pair_avg = (1 - weight_x) * s + weight_x * t;
+	float top_pair_avg = (1 - weight_x) * u + weight_x * v;
+	return (1 - weight_y) * top_pair_avg + weight_y * bottom_pair_avg;
+};
+
+/*
+ * The kernels below are all instantiated from these two bodies. They're
+ * meant to be inlined with compile-time constant arguments: a constant step
+ * turns divisions and modulos into multiplications, powers of two turn them
+ * into shifts, and the generic kernels multiply by the map's step_reciprocal.
+ * Nothing divides at runtime.
+ *
+ * Within a cell, offsets only take step distinct values, so the normalised
+ * offsets and their fade weights are looked up rather than computed.
+ */
+enum step_division {
+	// The step is a compile-time constant, the compiler knows best
+	DIVIDE_BY_CONSTANT,
+	DIVIDE_BY_SHIFT,
+	DIVIDE_BY_RECIPROCAL,
+};
+
+static inline unsigned int step_segment(const struct elevation_map *map, const unsigned int step, const enum step_division division, unsigned int value) {
+	switch (division) {
+		case DIVIDE_BY_SHIFT:
+			return value >> map->step_shift;
+		case DIVIDE_BY_RECIPROCAL:
+			return (unsigned int) (((Uint64) value * map->step_reciprocal) >> 32);
+		default:
+			return value / step;
+	}
+};
+
+static inline float point_noise(const struct elevation_map *map, const unsigned int step, const enum step_division division, unsigned int map_x, unsigned int map_y) {
+	const unsigned int segment_x = step_segment(map, step, division, map_x);
+	const unsigned int segment_y = step_segment(map, step, division, map_y);
+	const unsigned int offset_x = map_x - segment_x * step;
+	const unsigned int offset_y = map_y - segment_y * step;
+
+	return cell_noise(map, segment_x, segment_y, offset_x, offset_y);
+};
+
+static inline void row_noise(const struct elevation_map *map, const unsigned int step, const enum step_division division, unsigned int map_x, unsigned int map_y, unsigned int count, float * restrict noise, struct vector * restrict gradients) {
+	/*
+	 * gradients is either NULL, or gets the derivative of the noise along x
+	 * and y, per map unit. Callers pass a constant NULL when they don't want
+	 * it, so that the code for it disappears once inlined.
+	 */
+	// Whatever lies outside the map is 0, and flat
+	unsigned int inside = 0;
+	if (map_y < map->height && map_x < map->width)
+		inside = (count < map->width - map_x) ? count : map->width - map_x;
+
+	unsigned int sample_idx;
+	for (sample_idx = inside; sample_idx < count; ++sample_idx) {
+		noise[sample_idx] = 0.;
+		if (gradients)
+			gradients[sample_idx] = (struct vector) { .x = 0., .y = 0. };
+	}
+	if (!inside)
+		return;
+
+	unsigned int segment_x = step_segment(map, step, division, map_x);
+	unsigned int offset_x = map_x - segment_x * step;
+	const unsigned int segment_y = step_segment(map, step, division, map_y);
+	const unsigned int offset_y = map_y - segment_y * step;
+	const float from_above = map->cell_offsets[offset_y];
+	const float weight_y = map->fade_weights[offset_y];
+	const float slope_y = map->fade_slopes[offset_y];
+	const float inv_step = 1.f / step;
+	const float * restrict cell_offsets = map->cell_offsets;
+	const float * restrict fade_weights = map->fade_weights;
+	const float * restrict fade_slopes = map->fade_slopes;
+
+	/*
+	 * One cell at a time: the four corner vectors, and everything that only
+	 * depends on y, are the same for the whole span of the row in the cell.
+	 */
+	sample_idx = 0;
+	while (sample_idx < inside) {
+		unsigned int span = step - offset_x;
+		if (span > inside - sample_idx)
+			span = inside - sample_idx;
+
+		const struct vector *above = &map->node_vectors[segment_y * map->nodes_per_row + segment_x];
+		const struct vector *below = above + map->nodes_per_row;
+		const float s_y = below[0].y * (from_above - 1);
+		const float t_y = below[1].y * (from_above - 1);
+		const float u_y = above[0].y * from_above;
+		const float v_y = above[1].y * from_above;
+
+		float * restrict span_noise = &noise[sample_idx];
+		unsigned int span_idx;
+		for (span_idx = 0; span_idx < span; ++span_idx) {
+			const float from_left = cell_offsets[offset_x + span_idx];
+			const float s = below[0].x * from_left + s_y;
+			const float t = below[1].x * (from_left - 1) + t_y;
+			const float u = above[0].x * from_left + u_y;
+			const float v = above[1].x * (from_left - 1) + v_y;
+
+			const float weight_x = fade_weights[offset_x + span_idx];
+			const float bottom_pair_avg = (1 - weight_x) * s + weight_x * t;
+			const float top_pair_avg = (1 - weight_x) * u + weight_x * v;
+			span_noise[span_idx] = (1 - weight_y) * top_pair_avg + weight_y * bottom_pair_avg;
+
+			if (gradients) {
+				// Product rule through both interpolations
+				const float slope_x = fade_slopes[offset_x + span_idx];
+				const float top_dx = above[0].x + weight_x * (above[1].x - above[0].x) + slope_x * (v - u);
+				const float bottom_dx = below[0].x + weight_x * (below[1].x - below[0].x) + slope_x * (t - s);
+				const float top_dy = above[0].y + weight_x * (above[1].y - above[0].y);
+				const float bottom_dy = below[0].y + weight_x * (below[1].y - below[0].y);
+
+				gradients[sample_idx + span_idx].x = inv_step * (top_dx + weight_y * (bottom_dx - top_dx));
+				gradients[sample_idx + span_idx].y = inv_step * (
+					top_dy + weight_y * (bottom_dy - top_dy)
+					+ slope_y * (bottom_pair_avg - top_pair_avg)
+				);
+			}
+		}
+
+		sample_idx += span;
+		offset_x = 0;
+		segment_x++;
+	}
+};
+
+static float point_noise_generic(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
+	return point_noise(map, map->step, DIVIDE_BY_RECIPROCAL, map_x, map_y);
+};
+
+static void row_noise_generic(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise) {
+	row_noise(map, map->step, DIVIDE_BY_RECIPROCAL, map_x, map_y, count, noise, NULL);
+};
+
+static void row_gradients_generic(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise, struct vector *gradients) {
+	row_noise(map, map->step, DIVIDE_BY_RECIPROCAL, map_x, map_y, count, noise, gradients);
+};
+
+static float point_noise_power_of_two(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
+	return point_noise(map, map->step, DIVIDE_BY_SHIFT, map_x, map_y);
+};
+
+static void row_noise_power_of_two(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise) {
+	row_noise(map, map->step, DIVIDE_BY_SHIFT, map_x, map_y, count, noise, NULL);
+};
+
+static void row_gradients_power_of_two(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise, struct vector *gradients) {
+	row_noise(map, map->step, DIVIDE_BY_SHIFT, map_x, map_y, count, noise, gradients);
+};
+
+#define NOISE_KERNELS_FOR_STEP(step) \
+static float point_noise_step_##step(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) { \
+	return point_noise(map, step, DIVIDE_BY_CONSTANT, map_x, map_y); \
+}; \
+\
+static void row_noise_step_##step(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise) { \
+	row_noise(map, step, DIVIDE_BY_CONSTANT, map_x, map_y, count, noise, NULL); \
+}; \
+\
+static void row_gradients_step_##step(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise, struct vector *gradients) { \
+	row_noise(map, step, DIVIDE_BY_CONSTANT, map_x, map_y, count, noise, gradients); \
+};
+
+// perlin.c uses 25, terrain.c 80
+NOISE_KERNELS_FOR_STEP(25)
+NOISE_KERNELS_FOR_STEP(50)
+NOISE_KERNELS_FOR_STEP(80)
+NOISE_KERNELS_FOR_STEP(100)
+
+/*
+ * In order of preference, the first kernel that supports a step is the one
+ * maps with that step use
+ */
+const struct noise_kernel noise_kernels[] = {
+	{ .name = "step 25", .step = 25, .point = point_noise_step_25, .row = row_noise_step_25, .row_gradients = row_gradients_step_25 },
+	{ .name = "step 50", .step = 50, .point = point_noise_step_50, .row = row_noise_step_50, .row_gradients = row_gradients_step_50 },
+	{ .name = "step 80", .step = 80, .point = point_noise_step_80, .row = row_noise_step_80, .row_gradients = row_gradients_step_80 },
+	{ .name = "step 100", .step = 100, .point = point_noise_step_100, .row = row_noise_step_100, .row_gradients = row_gradients_step_100 },
+	{ .name = "power of two", .power_of_two = true, .point = point_noise_power_of_two, .row = row_noise_power_of_two, .row_gradients = row_gradients_power_of_two },
+	{ .name = "generic", .point = point_noise_generic, .row = row_noise_generic, .row_gradients = row_gradients_generic },
+};
+
+const unsigned int noise_kernel_count = sizeof(noise_kernels) / sizeof(noise_kernels[0]);
+
+bool noise_kernel_supports(const struct noise_kernel *kernel, unsigned int step) {
+	if (kernel->power_of_two)
+		return 0 == (step & (step - 1));
+	return (0 == kernel->step) || (step == kernel->step);
+};
+
+const struct noise_kernel *select_noise_kernel(unsigned int step) {
+	unsigned int kernel_idx;
+	for (kernel_idx = 0; kernel_idx < noise_kernel_count; ++kernel_idx)
+		if (noise_kernel_supports(&noise_kernels[kernel_idx], step))
+			break;
+	return &noise_kernels[kernel_idx];
+};
+
+float get_map_noise(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
+	if (map_x >= map->width || map_y >= map->height)
+		return 0.;
+
+	return map->kernel->point(map, map_x, map_y);
+};
+
+float normalise_elevation(const struct elevation_map *map, float noise) {
+	/*
+	 * This is a bit arbitrary, but we need to normalise the elevation so it
+	 * ends up 0 <= x <= 1
+	 */
+	float elevation = (noise - map->normalised_min) / (map->normalised_max - map->normalised_min);
+	if (elevation < 0)
+		elevation=0;
+	if (elevation > 1)
+		elevation=1;
+
+	return elevation;
+};
+
+float get_map_elevation(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
+	if (map_x >= map->width || map_y >= map->height)
+		return 0.;
+
+	return normalise_elevation(map, get_map_noise(map, map_x, map_y));
+};
+
+void get_map_row_noise(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *noise) {
+	map->kernel->row(map, map_x, map_y, count, noise);
+};
+
+void get_map_row_elevations(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *elevations) {
+	/*
+	 * count elevations along a row of the map, starting from (map_x, map_y)
+	 */
+	get_map_row_noise(map, map_x, map_y, count, elevations);
+
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx < count; ++sample_idx) {
+		if (map_x + sample_idx < map->width && map_y < map->height)
+			elevations[sample_idx] = normalise_elevation(map, elevations[sample_idx]);
+		else
+			elevations[sample_idx] = 0.;
+	}
+};
+
+void get_map_row_gradients(const struct elevation_map *map, unsigned int map_x, unsigned int map_y, unsigned int count, float *elevations, struct vector *gradients) {
+	/*
+	 * Same as get_map_row_elevations, plus the slope of the elevation along
+	 * x and y per map unit, in the same pass. Where the elevation is clamped
+	 * by normalise_elevation, the terrain is flat.
+	 */
+	map->kernel->row_gradients(map, map_x, map_y, count, elevations, gradients);
+
+	const float scale = 1. / (map->normalised_max - map->normalised_min);
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx < count; ++sample_idx) {
+		float noise = elevations[sample_idx];
+		bool clamped = (noise <= map->normalised_min) || (noise >= map->normalised_max);
+		if (map_x + sample_idx >= map->width || map_y >= map->height) {
+			elevations[sample_idx] = 0.;
+			clamped = true;
+		} else
+			elevations[sample_idx] = normalise_elevation(map, noise);
+
+		gradients[sample_idx].x = clamped ? 0. : gradients[sample_idx].x * scale;
+		gradients[sample_idx].y = clamped ? 0. : gradients[sample_idx].y * scale;
+	}
+};
+
+void create_noise_vectors(struct elevation_map *map) {
+	assert((map->width) % map->step == 0);
+	assert((map->height) % map->step == 0);
+	assert((Uint64) map->width * map->step <= UINT32_MAX && (Uint64) map->height * map->step <= UINT32_MAX);
+
+	// The map needn't be square, exported heightmaps seldom are
+	const unsigned int nodes_per_row = 1 + (map->width / map->step);
+	const unsigned int nodes_per_column = 1 + (map->height / map->step);
+
+	// Everything the sampling kernels would otherwise recompute every time
+	map->nodes_per_row = nodes_per_row;
+	map->step_shift = 0;
+	while ((1u << (map->step_shift + 1)) <= map->step)
+		map->step_shift++;
+	/*
+	 * floor(2^32 / step) + 1: multiplying by it and dropping the low 32 bits
+	 * divides exactly, as long as coordinates times step fit in 32 bits
+	 */
+	map->step_reciprocal = ((Uint64) 1 << 32) / map->step + 1;
+	map->kernel = select_noise_kernel(map->step);
+	if (0 == map->normalised_min && 0 == map->normalised_max) {
+		map->normalised_min = TERRAIN_NORMALISED_MIN;
+		map->normalised_max = TERRAIN_NORMALISED_MAX;
+	}
+
+	/*
+	 * The lattice is allocated in one go, and recreating it reuses the
+	 * memory of the previous one
+	 */
+	struct arena *arena = &map->lattice_arena;
+	reset_arena(arena);
+
+	// Normalised offsets within a cell and their fade weights
+	map->cell_offsets = (float*) arena_alloc(arena, map->step * sizeof(float));
+	map->fade_weights = (float*) arena_alloc(arena, map->step * sizeof(float));
+	map->fade_slopes = (float*) arena_alloc(arena, map->step * sizeof(float));
+	unsigned int offset;
+	for (offset = 0; offset < map->step; ++offset) {
+		map->cell_offsets[offset] = (float) offset / map->step;
+		map->fade_weights[offset] = increasing_interpolant(map->cell_offsets[offset]);
+		map->fade_slopes[offset] = increasing_interpolant_slope(map->cell_offsets[offset]);
+	}
+
+	// Allocate vectors
+	map->node_vectors = (struct vector*) arena_calloc(
+		arena,
+		(size_t) nodes_per_row * nodes_per_column,
+		sizeof(struct vector)
+	);
+
+	Uint32 random_state = map->lattice_seed;
+	Uint32 *random = map->lattice_seed ? &random_state : NULL;
+
+	// Would be nice if there were a nicer way that doesn't rely on integer
+	// counters
+	unsigned int node_x, node_y;
+	for(node_y = 0; node_y < nodes_per_column; ++node_y)
+		for(node_x = 0; node_x < nodes_per_row; ++node_x)
+			random_unit_vector(&map->node_vectors[node_y * nodes_per_row + node_x], random);
+};
+
+void free_elevation_map(struct elevation_map *map) {
+	free_arena(&map->lattice_arena);
+	free(map->elevations);
+	free(map->gradients);
+	map->node_vectors = NULL;
+	map->cell_offsets = map->fade_weights = map->fade_slopes = NULL;
+	map->elevations = NULL;
+	map->gradients = NULL;
+};
+
+void cache_elevations(struct elevation_map *map) {
+	/*
+	 * Elevations and their gradients come out of the same pass. Caching them
+	 * again, after the lattice or the normalisation have changed, reuses the
+	 * existing cache.
+	 */
+	if (!map->elevations)
+		map->elevations = (float*) malloc((size_t) map->width * map->height * sizeof(float));
+	if (!map->gradients)
+		map->gradients = (struct vector*) malloc((size_t) map->width * map->height * sizeof(struct vector));
+
+	unsigned int map_y;
+	for (map_y = 0; map_y < map->height; ++map_y) {
+		size_t row_offset = (size_t) map_y * map->width;
+		get_map_row_gradients(map, 0, map_y, map->width, &map->elevations[row_offset], &map->gradients[row_offset]);
+	}
+};
+
+float sample_elevation(const struct elevation_map *map, float map_x, float map_y) {
+	float elevation;
+	sample_elevations(map, 1, &map_x, &map_y, &elevation);
+	return elevation;
+};
+
+void sample_elevations(const struct elevation_map *map, unsigned int count, const float * restrict xs, const float * restrict ys, float * restrict elevations) {
+	/*
+	 * Bilinear interpolation between the four cached elevations around each
+	 * sample. Outside the map, elevation is 0 just like in get_map_elevation.
+	 *
+	 * The loop body is deliberately branch-free (clamps and selects rather
+	 * than early returns) so that the compiler can vectorise it across the
+	 * batch.
+	 */
+	const float * restrict cached = map->elevations;
+	const float max_x = map->width - 1;
+	const float max_y = map->height - 1;
+
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx < count; ++sample_idx) {
+		const float x = xs[sample_idx];
+		const float y = ys[sample_idx];
+		const bool inside = (x >= 0) & (y >= 0) & (x <= max_x) & (y <= max_y);
+
+		// The top-left corner of the cell must leave room for its neighbours
+		const float clamped_x = fminf(fmaxf(x, 0), max_x - 1);
+		const float clamped_y = fminf(fmaxf(y, 0), max_y - 1);
+		const unsigned int left_x = (unsigned int) clamped_x;
+		const unsigned int top_y = (unsigned int) clamped_y;
+		const float fraction_x = fminf(fmaxf(x, 0), max_x) - left_x;
+		const float fraction_y = fminf(fmaxf(y, 0), max_y) - top_y;
+
+		const float *above = &cached[(size_t) top_y * map->width + left_x];
+		const float *below = above + map->width;
+
+		const float top = above[0] + fraction_x * (above[1] - above[0]);
+		const float bottom = below[0] + fraction_x * (below[1] - below[0]);
+		const float elevation = top + fraction_y * (bottom - top);
+
+		elevations[sample_idx] = inside ? elevation : 0.;
+	}
+};
+
+void sample_gradients(const struct elevation_map *map, unsigned int count, const float * restrict xs, const float * restrict ys, struct vector * restrict gradients) {
+	/*
+	 * Like sample_elevations, for the cached gradients. Outside the map,
+	 * everything is flat.
+	 */
+	const struct vector * restrict cached = map->gradients;
+	const float max_x = map->width - 1;
+	const float max_y = map->height - 1;
+
+	unsigned int sample_idx;
+	for (sample_idx = 0; sample_idx < count; ++sample_idx) {
+		const float x = xs[sample_idx];
+		const float y = ys[sample_idx];
+		const bool inside = (x >= 0) & (y >= 0) & (x <= max_x) & (y <= max_y);
+
+		const float clamped_x = fminf(fmaxf(x, 0), max_x - 1);
+		const float clamped_y = fminf(fmaxf(y, 0), max_y - 1);
+		const unsigned int left_x = (unsigned int) clamped_x;
+		const unsigned int top_y = (unsigned int) clamped_y;
+		const float fraction_x = fminf(fmaxf(x, 0), max_x) - left_x;
+		const float fraction_y = fminf(fmaxf(y, 0), max_y) - top_y;
+
+		const struct vector *above = &cached[(size_t) top_y * map->width + left_x];
+		const struct vector *below = above + map->width;
+
+		const float top_x = above[0].x + fraction_x * (above[1].x - above[0].x);
+		const float bottom_x = below[0].x + fraction_x * (below[1].x - below[0].x);
+		const float top_y_slope = above[0].y + fraction_x * (above[1].y - above[0].y);
+		const float bottom_y_slope = below[0].y + fraction_x * (below[1].y - below[0].y);
+
+		gradients[sample_idx].x = inside ? top_x + fraction_y * (bottom_x - top_x) : 0.;
+		gradients[sample_idx].y = inside ? top_y_slope + fraction_y * (bottom_y_slope - top_y_slope) : 0.;
+	}
+};
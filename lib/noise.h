@@ -0,0 +1,127 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <stdbool.h>
+
+#include "SDL.h"
+
+#include "arena.h"
+
+#ifndef M_PI
+#define M_PI			3.14159265358979323846
+#endif
+
+/*
+ * Raw gradient noise is roughly within these bounds, elevations are
+ * normalised from them to 0 <= elevation <= 1. These are the defaults for
+ * the map's normalised_min and normalised_max.
+ */
+#define TERRAIN_NORMALISED_MIN	-0.5
+#define TERRAIN_NORMALISED_MAX	0.65
+
+struct vector {
+	// TODO Use ints. Or maybe not. But figure out a way to make this more
+	// efficient if need be. Maybe. Perhaps.
+	float x;
+	float y;
+};
+
+struct colour_ramp;
+struct elevation_map;
+
+/*
+ * Noise sampling code, specialised for some steps. See create_noise_vectors
+ * and select_noise_kernel
+ */
+struct noise_kernel {
+	const char *name;
+	// A step of 0 means any step, unless the kernel is for powers of two
+	unsigned int step;
+	bool power_of_two;
+	float (*point)(const struct elevation_map*, unsigned int, unsigned int);
+	void (*row)(const struct elevation_map*, unsigned int, unsigned int, unsigned int, float*);
+	// Same as row, and the noise's gradient along with it
+	void (*row_gradients)(const struct elevation_map*, unsigned int, unsigned int, unsigned int, float*, struct vector*);
+};
+
+extern const struct noise_kernel noise_kernels[];
+
+extern const unsigned int noise_kernel_count;
+
+/*
+ * A width x height field of gradient noise, with random unit vectors on the
+ * nodes of a grid of cells step units on the side
+ */
+struct elevation_map {
+	unsigned int width;
+	unsigned int height;
+	unsigned int step;
+	// Both 0 means TERRAIN_NORMALISED_MIN and TERRAIN_NORMALISED_MAX
+	float normalised_min;
+	float normalised_max;
+	/*
+	 * 0 means the node vectors come from rand(). Anything else seeds a
+	 * generator of the map's own, which gives the same lattice whatever the C
+	 * library.
+	 */
+	Uint32 lattice_seed;
+	struct colour_ramp *colour_ramp;
+	struct vector *node_vectors;
+	// These are all set by create_noise_vectors
+	const struct noise_kernel *kernel;
+	unsigned int nodes_per_row;
+	unsigned int step_shift;
+	Uint64 step_reciprocal;
+	// step entries each, indexed by the offset within a cell
+	float *cell_offsets;
+	float *fade_weights;
+	float *fade_slopes;
+	// Holds the node vectors and the tables above
+	struct arena lattice_arena;
+	// Elevation and its gradient at every integer coordinate, see
+	// cache_elevations
+	float *elevations;
+	struct vector *gradients;
+};
+
+float next_lattice_random(Uint32*);
+
+void random_unit_vector(struct vector*, Uint32*);
+
+float increasing_interpolant(float);
+
+float increasing_interpolant_slope(float);
+
+float dot_product(const struct vector*, const struct vector*);
+
+bool noise_kernel_supports(const struct noise_kernel*, unsigned int);
+
+const struct noise_kernel *select_noise_kernel(unsigned int);
+
+void create_noise_vectors(struct elevation_map*);
+
+void free_elevation_map(struct elevation_map*);
+
+float normalise_elevation(const struct elevation_map*, float);
+
+float reference_map_noise(const struct elevation_map*, unsigned int, unsigned int);
+
+float get_map_noise(const struct elevation_map*, unsigned int, unsigned int);
+
+float get_map_elevation(const struct elevation_map*, unsigned int, unsigned int);
+
+void get_map_row_noise(const struct elevation_map*, unsigned int, unsigned int, unsigned int, float*);
+
+void get_map_row_elevations(const struct elevation_map*, unsigned int, unsigned int, unsigned int, float*);
+
+void get_map_row_gradients(const struct elevation_map*, unsigned int, unsigned int, unsigned int, float*, struct vector*);
+
+void cache_elevations(struct elevation_map*);
+
+float sample_elevation(const struct elevation_map*, float, float);
+
+void sample_elevations(const struct elevation_map*, unsigned int, const float*, const float*, float*);
+
+void sample_gradients(const struct elevation_map*, unsigned int, const float*, const float*, struct vector*);
+
+#endif
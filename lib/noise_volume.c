@@ -0,0 +1,200 @@
+#include <math.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "noise.h"
+#include "noise_volume.h"
+
+void random_unit_vector3(struct vector3 *dest, Uint32 *random) {
+	// Uniform on the sphere: uniform height, uniform angle around the axis
+	float z = random ? next_lattice_random(random) * 2 - 1 : ((float) rand() * 2) / RAND_MAX - 1;
+	float angle = random
+		? next_lattice_random(random) * 2 * M_PI
+		: ((float) rand() * 2 * M_PI) / (RAND_MAX);
+	float radius = sqrt(1 - z * z);
+	dest->x = radius * cos(angle);
+	dest->y = radius * sin(angle);
+	dest->z = z;
+};
+
+void create_noise_volume(struct noise_volume *volume) {
+	assert((volume->width) % volume->step == 0);
+	assert((volume->height) % volume->step == 0);
+	assert(volume->period > 0);
+
+	volume->nodes_per_row = 1 + (volume->width / volume->step);
+	volume->nodes_per_layer = volume->nodes_per_row * (1 + (volume->height / volume->step));
+
+	struct arena *arena = &volume->lattice_arena;
+	reset_arena(arena);
+
+	volume->cell_offsets = (float*) arena_alloc(arena, volume->step * sizeof(float));
+	volume->fade_weights = (float*) arena_alloc(arena, volume->step * sizeof(float));
+	unsigned int offset;
+	for (offset = 0; offset < volume->step; ++offset) {
+		volume->cell_offsets[offset] = (float) offset / volume->step;
+		volume->fade_weights[offset] = increasing_interpolant(volume->cell_offsets[offset]);
+	}
+
+	// The last layer wraps around to the first one, so it isn't stored
+	size_t node_count = (size_t) volume->nodes_per_layer * volume->period;
+	volume->node_vectors = (struct vector3*) arena_calloc(arena, node_count, sizeof(struct vector3));
+
+	Uint32 random_state = volume->lattice_seed;
+	Uint32 *random = volume->lattice_seed ? &random_state : NULL;
+	size_t node_idx;
+	for (node_idx = 0; node_idx < node_count; ++node_idx)
+		random_unit_vector3(&volume->node_vectors[node_idx], random);
+};
+
+void free_noise_volume(struct noise_volume *volume) {
+	free_arena(&volume->lattice_arena);
+	volume->node_vectors = NULL;
+	volume->cell_offsets = volume->fade_weights = NULL;
+};
+
+static void time_layers(const struct noise_volume *volume, float time, unsigned int *front, unsigned int *back, float *from_front) {
+	// Which two layers of nodes time falls in between, and how far along
+	float cells = time / volume->step;
+	float whole = floorf(cells);
+	*from_front = cells - whole;
+
+	long layer = (long) whole % (long) volume->period;
+	if (layer < 0)
+		layer += volume->period;
+	*front = layer;
+	*back = (layer + 1) % volume->period;
+};
+
+float get_volume_noise(const struct noise_volume *volume, unsigned int map_x, unsigned int map_y, float time) {
+	/*
+	 * The straightforward version: eight dot products, then interpolate
+	 * along x, y and time in turn.
+	 */
+	if (map_x >= volume->width || map_y >= volume->height)
+		return 0.;
+
+	unsigned int front, back;
+	float from_front;
+	time_layers(volume, time, &front, &back, &from_front);
+
+	unsigned int segment_x = map_x / volume->step;
+	unsigned int segment_y = map_y / volume->step;
+	float from_left = (float) (map_x % volume->step) / volume->step;
+	float from_above = (float) (map_y % volume->step) / volume->step;
+
+	float corners[2][2][2];
+	unsigned int layer_idx, corner_x, corner_y;
+	for (layer_idx = 0; layer_idx < 2; ++layer_idx) {
+		unsigned int layer = layer_idx ? back : front;
+		for (corner_y = 0; corner_y < 2; ++corner_y)
+			for (corner_x = 0; corner_x < 2; ++corner_x) {
+				const struct vector3 *node = &volume->node_vectors[
+					layer * volume->nodes_per_layer
+					+ (segment_y + corner_y) * volume->nodes_per_row
+					+ segment_x + corner_x
+				];
+				corners[layer_idx][corner_y][corner_x] =
+					node->x * (from_left - corner_x)
+					+ node->y * (from_above - corner_y)
+					+ node->z * (from_front - layer_idx);
+			}
+	}
+
+	float weight_x = increasing_interpolant(from_left);
+	float weight_y = increasing_interpolant(from_above);
+	float weight_t = increasing_interpolant(from_front);
+
+	float layers[2];
+	for (layer_idx = 0; layer_idx < 2; ++layer_idx) {
+		float top = (1 - weight_x) * corners[layer_idx][0][0] + weight_x * corners[layer_idx][0][1];
+		float bottom = (1 - weight_x) * corners[layer_idx][1][0] + weight_x * corners[layer_idx][1][1];
+		layers[layer_idx] = (1 - weight_y) * top + weight_y * bottom;
+	}
+	return (1 - weight_t) * layers[0] + weight_t * layers[1];
+};
+
+void get_volume_row_noise(const struct noise_volume *volume, unsigned int map_x, unsigned int map_y, float time, unsigned int count, float * restrict noise) {
+	// Whatever lies outside the volume is 0
+	unsigned int inside = 0;
+	if (map_y < volume->height && map_x < volume->width)
+		inside = (count < volume->width - map_x) ? count : volume->width - map_x;
+
+	unsigned int sample_idx;
+	for (sample_idx = inside; sample_idx < count; ++sample_idx)
+		noise[sample_idx] = 0.;
+	if (!inside)
+		return;
+
+	unsigned int front, back;
+	float from_front;
+	time_layers(volume, time, &front, &back, &from_front);
+	const float weight_t = increasing_interpolant(from_front);
+
+	const unsigned int step = volume->step;
+	unsigned int segment_x = map_x / step;
+	unsigned int offset_x = map_x % step;
+	const unsigned int segment_y = map_y / step;
+	const unsigned int offset_y = map_y % step;
+	const float from_above = volume->cell_offsets[offset_y];
+	const float weight_y = volume->fade_weights[offset_y];
+	const float * restrict cell_offsets = volume->cell_offsets;
+	const float * restrict fade_weights = volume->fade_weights;
+
+	/*
+	 * Time and y are the same for the whole row, so within a cell the
+	 * interpolation along time can be done up front, on the corners'
+	 * coefficients: every corner ends up as slope * (from_left - x) + level,
+	 * and what's left for each sample is the same bilinear blend as in 2D.
+	 */
+	sample_idx = 0;
+	while (sample_idx < inside) {
+		unsigned int span = step - offset_x;
+		if (span > inside - sample_idx)
+			span = inside - sample_idx;
+
+		const struct vector3 *front_above = &volume->node_vectors[
+			front * volume->nodes_per_layer + segment_y * volume->nodes_per_row + segment_x
+		];
+		const struct vector3 *back_above = &volume->node_vectors[
+			back * volume->nodes_per_layer + segment_y * volume->nodes_per_row + segment_x
+		];
+		const struct vector3 *front_below = front_above + volume->nodes_per_row;
+		const struct vector3 *back_below = back_above + volume->nodes_per_row;
+
+#define CORNER_SLOPE(f, b) ((1 - weight_t) * (f).x + weight_t * (b).x)
+#define CORNER_LEVEL(f, b, dy) ( \
+	(1 - weight_t) * ((f).y * (dy) + (f).z * from_front) \
+	+ weight_t * ((b).y * (dy) + (b).z * (from_front - 1)) \
+)
+		const float s_slope = CORNER_SLOPE(front_below[0], back_below[0]);
+		const float t_slope = CORNER_SLOPE(front_below[1], back_below[1]);
+		const float u_slope = CORNER_SLOPE(front_above[0], back_above[0]);
+		const float v_slope = CORNER_SLOPE(front_above[1], back_above[1]);
+		const float s_level = CORNER_LEVEL(front_below[0], back_below[0], from_above - 1);
+		const float t_level = CORNER_LEVEL(front_below[1], back_below[1], from_above - 1);
+		const float u_level = CORNER_LEVEL(front_above[0], back_above[0], from_above);
+		const float v_level = CORNER_LEVEL(front_above[1], back_above[1], from_above);
+#undef CORNER_SLOPE
+#undef CORNER_LEVEL
+
+		float * restrict span_noise = &noise[sample_idx];
+		unsigned int span_idx;
+		for (span_idx = 0; span_idx < span; ++span_idx) {
+			const float from_left = cell_offsets[offset_x + span_idx];
+			const float s = s_slope * from_left + s_level;
+			const float t = t_slope * (from_left - 1) + t_level;
+			const float u = u_slope * from_left + u_level;
+			const float v = v_slope * (from_left - 1) + v_level;
+
+			const float weight_x = fade_weights[offset_x + span_idx];
+			const float bottom_pair_avg = (1 - weight_x) * s + weight_x * t;
+			const float top_pair_avg = (1 - weight_x) * u + weight_x * v;
+			span_noise[span_idx] = (1 - weight_y) * top_pair_avg + weight_y * bottom_pair_avg;
+		}
+
+		sample_idx += span;
+		offset_x = 0;
+		segment_x++;
+	}
+};
@@ -0,0 +1,48 @@
+#ifndef NOISE_VOLUME_H
+#define NOISE_VOLUME_H
+
+#include "SDL.h"
+
+#include "arena.h"
+
+struct vector3 {
+	float x;
+	float y;
+	float z;
+};
+
+/*
+ * Gradient noise over width x height x time, with random unit vectors on the
+ * nodes of a grid of cubes step units on the side. Time goes on forever but
+ * the lattice only has period layers of nodes, so the noise loops every
+ * period * step units of time.
+ */
+struct noise_volume {
+	unsigned int width;
+	unsigned int height;
+	unsigned int step;
+	unsigned int period;
+	// Same as an elevation map's
+	Uint32 lattice_seed;
+	struct vector3 *node_vectors;
+	// These are all set by create_noise_volume
+	unsigned int nodes_per_row;
+	unsigned int nodes_per_layer;
+	// step entries each, indexed by the offset within a cell
+	float *cell_offsets;
+	float *fade_weights;
+	// Holds the node vectors and the tables above
+	struct arena lattice_arena;
+};
+
+void random_unit_vector3(struct vector3*, Uint32*);
+
+void create_noise_volume(struct noise_volume*);
+
+void free_noise_volume(struct noise_volume*);
+
+float get_volume_noise(const struct noise_volume*, unsigned int, unsigned int, float);
+
+void get_volume_row_noise(const struct noise_volume*, unsigned int, unsigned int, float, unsigned int, float*);
+
+#endif
@@ -0,0 +1,108 @@
+#include <math.h>
+
+#include "plasma.h"
+
+/* sin(-a) = -sin(a) */
+#define SIN(x) (x>=0?sin_array[x]:-sin_array[-x])
+
+static int sin_array[SIN_INDICES];
+
+void prepare_sin() {
+	unsigned int i;
+	for (i=0; i < SIN_INDICES; ++i)
+		sin_array[i] = (int) (SIN_AMPLITUDE * sin(2 * M_PI * i / SIN_INDICES));
+};
+
+void prepare_palette(SDL_Palette *plasma_palette, unsigned int time) {
+	/* The values we read from the sin curve are
+	 * -SIN_AMPLITUDE <= x <= SIN_AMPLITUDE
+	 * We use 4 points on the curve, therefore the index of a point on the
+	 * plasma surface will be:
+	 * -4*SIN_AMPLITUDE < pixel_palette_index < 4*SIN_AMPLITUDE
+	 */
+	static int redfactor = 1, greenfactor = 2, bluefactor = 3;
+	static int redphase = 0, greenphase = 50, bluephase = 100;
+
+	unsigned int red, green, blue;
+	unsigned int base_red, base_green, base_blue;
+
+	// These are the base values for index 0 of the palette
+	base_red = time * redfactor + redphase;
+	base_green = time * greenfactor + greenphase;
+	base_blue = time * bluefactor + bluephase;
+
+	/*
+	 * Ultimately, the R, G and B components in the palette must be
+	 * 0 <= r,g,b <= 255
+	 *
+	 * The red, green and blue factors derived from the time counter are
+	 * monotonically increasing quantities, type notwithstanding (ie, they'd
+	 * grow to infinity given enough bits).
+	 *
+	 * What we want is for each component value to grow from 0 to 255 and back
+	 * down to 0. The rockbox code does this by doubling the least significant
+	 * byte of the values (ie, from 0 to * 510) and subtracting values greater
+	 * than 255 from 510 to ramp down.
+	 * It's pretty clever *but* it'll only work if the variables are stored in
+	 * types that allow values greater than 255. In other words, we must cast
+	 * to Uint8 *after* the conversion and ramp-down.
+	 */
+
+	for (unsigned int palette_idx = 0; palette_idx < PALETTE_COLOURS - 1; ++palette_idx) {
+		base_red &= 0xFF; red = 2 * base_red;
+		base_green &= 0xFF; green = 2 * base_green;
+		base_blue &= 0xFF; blue = 2 * base_blue;
+
+		if (red > 255)
+			red = 510 - red;
+		if (green > 255)
+			green = 510 - green;
+		if (blue > 255)
+			blue = 510 - blue;
+
+		plasma_palette->colors[palette_idx].r = (Uint8) red;
+		plasma_palette->colors[palette_idx].g = (Uint8) green;
+		plasma_palette->colors[palette_idx].b = (Uint8) blue;
+
+		base_red++; base_green++; base_blue++;
+	}
+};
+
+void draw_plasma_to_surface(SDL_Surface *plasma_surface, int p1, int p2, int p3, int p4) {
+	// These are used as indices on the sin curve. They may be positive or
+	// negative
+	int t1, t2, t3, t4;
+
+	int surface_row, row_offset;
+
+	int row_base_palette_index, pixel_palette_index;
+
+	t1 = p1;
+	t2 = p2;
+	for (surface_row = 0; surface_row < plasma_surface->h; ++surface_row) {
+
+		// XXX Why do we reset t3 and t4 for every row?
+		t3 = p3;
+		t4 = p4;
+
+		/* There are SIN_INDICES increments between 0 and 2PI,
+		 * therefore sin(x) = sin(x % SIN_INDICES)
+		 */
+		t1 %= SIN_INDICES;
+		t2 %= SIN_INDICES;
+
+		row_base_palette_index = SIN(t1) + SIN(t2);
+		for(row_offset = 0; row_offset < plasma_surface->w; ++row_offset) {
+			t3 %= SIN_INDICES;
+			t4 %= SIN_INDICES;
+
+			pixel_palette_index = row_base_palette_index + SIN(t3) + SIN(t4);
+
+			((Uint8*) plasma_surface->pixels)[plasma_surface->pitch * surface_row + row_offset] = (Uint8) (PLASMA_PEAK + pixel_palette_index);
+			t3 += 1;
+			t4 += 2;
+		}
+		t1 += 2;
+		t2 += 1;
+	}
+};
@@ -0,0 +1,29 @@
+#ifndef PLASMA_H
+#define PLASMA_H
+
+#include "SDL.h"
+
+#ifndef M_PI
+#define M_PI			3.14159265358979323846
+#endif
+
+#define PALETTE_DEPTH	8
+#define PALETTE_COLOURS (1<< PALETTE_DEPTH)
+
+#define PLASMA_PEAK		(PALETTE_COLOURS / 2)
+#define SIN_AMPLITUDE	(PLASMA_PEAK / 4)
+
+#define SIN_INDICES		256
+
+/*
+ * The old school plasma: four points moving along a sin curve, summed into
+ * an index in a palette that cycles over time. prepare_sin must be called
+ * before drawing anything.
+ */
+void prepare_sin();
+
+void prepare_palette(SDL_Palette*, unsigned int);
+
+void draw_plasma_to_surface(SDL_Surface*, int, int, int, int);
+
+#endif
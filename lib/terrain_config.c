@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "terrain_config.h"
+#include "terrain_render.h"
+
+void default_terrain_config(struct terrain_config *config) {
+	*config = (struct terrain_config) {
+		.step = TERRAIN_STEP,
+		.normalised_min = TERRAIN_NORMALISED_MIN,
+		.normalised_max = TERRAIN_NORMALISED_MAX,
+		.camera_z = TERRAIN_CAMERA_Z,
+		.view_depth = TERRAIN_VIEW_DEPTH,
+		.min_colour = 0x000080,
+		.max_colour = 0xFFFFFF,
+		.stop_count = 3,
+		.stops = {
+			{ .max = 0.3, .colour = 0x228B22 },
+			{ .max = 0.85, .colour = 0xC19A6B },
+			{ .max = 0.95, .colour = 0xC8C8C8 },
+		},
+	};
+};
+
+static bool parse_config_line(struct terrain_config *config, const char *key, const char *value) {
+	if (0 == strcmp(key, "step"))
+		return 1 == sscanf(value, "%u", &config->step) && config->step > 0;
+	if (0 == strcmp(key, "normalised_min"))
+		return 1 == sscanf(value, "%f", &config->normalised_min);
+	if (0 == strcmp(key, "normalised_max"))
+		return 1 == sscanf(value, "%f", &config->normalised_max);
+	if (0 == strcmp(key, "camera_height"))
+		return 1 == sscanf(value, "%f", &config->camera_z) && config->camera_z > 0;
+	if (0 == strcmp(key, "view_depth"))
+		return 1 == sscanf(value, "%u", &config->view_depth) && config->view_depth >= 2;
+	if (0 == strcmp(key, "ramp_min_colour"))
+		return 1 == sscanf(value, "%x", &config->min_colour);
+	if (0 == strcmp(key, "ramp_max_colour"))
+		return 1 == sscanf(value, "%x", &config->max_colour);
+	if (0 == strcmp(key, "ramp_stop")) {
+		if (config->stop_count == TERRAIN_CONFIG_MAX_STOPS)
+			return false;
+		struct ramp_stop *stop = &config->stops[config->stop_count];
+		// Stops must be strictly within the ramp, see push_gradient
+		if (2 != sscanf(value, "%f %x", &stop->max, &stop->colour) || stop->max <= 0 || stop->max >= 1)
+			return false;
+		config->stop_count++;
+		return true;
+	}
+	return false;
+};
+
+int load_terrain_config(struct terrain_config *config, const char *path) {
+	/*
+	 * The config is only updated if the whole file makes sense, so that a
+	 * half-saved or mistyped file doesn't break a running session.
+	 */
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return -1;
+	}
+
+	struct terrain_config loaded;
+	default_terrain_config(&loaded);
+	bool stops_seen = false;
+
+	int status = 0;
+	unsigned int line_number = 0;
+	char line[TERRAIN_CONFIG_MAX_LINE];
+	while (0 == status && fgets(line, sizeof(line), file)) {
+		++line_number;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char key[32];
+		int value_offset = 0;
+		if (1 != sscanf(line, " %31[a-z_] = %n", key, &value_offset)) {
+			// Blank lines are fine, anything else isn't
+			if (strspn(line, " \t\r\n") != strlen(line))
+				status = -1;
+		} else {
+			// The file's stops replace the default ones
+			if (0 == strcmp(key, "ramp_stop") && !stops_seen) {
+				loaded.stop_count = 0;
+				stops_seen = true;
+			}
+			if (!value_offset || !parse_config_line(&loaded, key, line + value_offset))
+				status = -1;
+		}
+
+		if (0 != status)
+			fprintf(stderr, "%s:%u: cannot make sense of this line\n", path, line_number);
+	}
+	fclose(file);
+
+	if (0 == status && loaded.normalised_max <= loaded.normalised_min) {
+		fprintf(stderr, "%s: normalised_max must be greater than normalised_min\n", path);
+		status = -1;
+	}
+
+	if (0 == status)
+		*config = loaded;
+	return status;
+};
+
+unsigned int terrain_config_changes(const struct terrain_config *old, const struct terrain_config *new) {
+	unsigned int changes = 0;
+
+	if (old->min_colour != new->min_colour || old->max_colour != new->max_colour || old->stop_count != new->stop_count)
+		changes |= CONFIG_RAMP;
+	unsigned int stop_idx;
+	for (stop_idx = 0; stop_idx < old->stop_count && stop_idx < new->stop_count; ++stop_idx)
+		if (old->stops[stop_idx].max != new->stops[stop_idx].max || old->stops[stop_idx].colour != new->stops[stop_idx].colour)
+			changes |= CONFIG_RAMP;
+
+	if (old->step != new->step)
+		changes |= CONFIG_LATTICE;
+	if (old->normalised_min != new->normalised_min || old->normalised_max != new->normalised_max)
+		changes |= CONFIG_ELEVATIONS;
+	if (old->view_depth != new->view_depth)
+		changes |= CONFIG_VIEW;
+	if (old->camera_z != new->camera_z)
+		changes |= CONFIG_CAMERA;
+
+	return changes;
+};
+
+void apply_ramp_config(struct colour_ramp *ramp, const struct terrain_config *config) {
+	clear_gradients(ramp);
+	ramp->min_colour = hex_to_colour(config->min_colour);
+	ramp->max_colour = hex_to_colour(config->max_colour);
+
+	unsigned int stop_idx;
+	for (stop_idx = 0; stop_idx < config->stop_count; ++stop_idx)
+		push_gradient(ramp, config->stops[stop_idx].max, hex_to_colour(config->stops[stop_idx].colour));
+	build_ramp_lut(ramp);
+};
+
+void apply_map_config(struct elevation_map *map, const struct terrain_config *config, unsigned int changes) {
+	/*
+	 * A new step means a new lattice, and new normalisation bounds mean the
+	 * cached elevations are stale. The map's size must be a multiple of the
+	 * new step.
+	 */
+	map->step = config->step;
+	map->normalised_min = config->normalised_min;
+	map->normalised_max = config->normalised_max;
+
+	if (changes & CONFIG_LATTICE)
+		create_noise_vectors(map);
+	if (changes & (CONFIG_LATTICE | CONFIG_ELEVATIONS))
+		cache_elevations(map);
+};
@@ -0,0 +1,66 @@
+#ifndef TERRAIN_CONFIG_H
+#define TERRAIN_CONFIG_H
+
+#include "colour_ramp.h"
+#include "noise.h"
+
+// Defaults for what isn't in the config file
+#define TERRAIN_STEP		80
+#define TERRAIN_VIEW_DEPTH	200
+
+#define TERRAIN_CONFIG_MAX_STOPS	16
+#define TERRAIN_CONFIG_MAX_LINE		256
+
+struct ramp_stop {
+	float max;
+	unsigned int colour;
+};
+
+/*
+ * Everything about the terrain that can be tuned without rebuilding. A
+ * config file has one "key = value" per line, # starts a comment:
+ *
+ *   step = 80
+ *   normalised_min = -0.5
+ *   normalised_max = 0.65
+ *   camera_height = 120
+ *   view_depth = 200
+ *   ramp_min_colour = 0x000080
+ *   ramp_max_colour = 0xFFFFFF
+ *   ramp_stop = 0.3 0x228B22
+ *
+ * and ramp_stop can be repeated. Whatever's left out keeps its default.
+ */
+struct terrain_config {
+	unsigned int step;
+	float normalised_min;
+	float normalised_max;
+	float camera_z;
+	unsigned int view_depth;
+	unsigned int min_colour;
+	unsigned int max_colour;
+	unsigned int stop_count;
+	struct ramp_stop stops[TERRAIN_CONFIG_MAX_STOPS];
+};
+
+// What has to be rebuilt when going from one config to another
+enum terrain_config_change {
+	CONFIG_RAMP = 1 << 0,
+	CONFIG_LATTICE = 1 << 1,
+	CONFIG_ELEVATIONS = 1 << 2,
+	CONFIG_VIEW = 1 << 3,
+	// Nothing to rebuild, every frame comes with the camera's altitude
+	CONFIG_CAMERA = 1 << 4,
+};
+
+void default_terrain_config(struct terrain_config*);
+
+int load_terrain_config(struct terrain_config*, const char*);
+
+unsigned int terrain_config_changes(const struct terrain_config*, const struct terrain_config*);
+
+void apply_ramp_config(struct colour_ramp*, const struct terrain_config*);
+
+void apply_map_config(struct elevation_map*, const struct terrain_config*, unsigned int);
+
+#endif
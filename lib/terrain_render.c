@@ -0,0 +1,334 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "colour_ramp.h"
+#include "terrain_render.h"
+
+void fill_pixel_rect(struct pixel_buffer *buffer, const SDL_Rect *rect, Uint32 pixel) {
+	int left = (rect->x < 0) ? 0 : rect->x;
+	int top = (rect->y < 0) ? 0 : rect->y;
+	int right = rect->x + rect->w;
+	int bottom = rect->y + rect->h;
+	if (right > (int) buffer->width)
+		right = buffer->width;
+	if (bottom > (int) buffer->height)
+		bottom = buffer->height;
+
+	int x, y;
+	for (y = top; y < bottom; ++y) {
+		Uint32 *row = &buffer->pixels[(size_t) y * buffer->width];
+		for (x = left; x < right; ++x)
+			row[x] = pixel;
+	}
+};
+
+
+void init_terrain_renderer(struct terrain_renderer *renderer, unsigned int thread_count, unsigned int width, unsigned int depth) {
+	renderer->arena = (struct arena) { .block_size = 0 };
+	renderer->depth = depth;
+	renderer->camera_z = TERRAIN_CAMERA_Z;
+	renderer->heading = 0.;
+	renderer->rectangles_per_row = TERRAIN_RECTANGLES_PER_ROW;
+	renderer->shading = true;
+
+	/*
+	 * Fog thickens smoothly from nothing at the fog start to opaque at the
+	 * fog end
+	 */
+	const float fog_start = TERRAIN_FOG_START * depth;
+	const float fog_end = TERRAIN_FOG_END * depth;
+	renderer->visible_depth = (fog_end < depth) ? (unsigned int) fog_end : depth;
+	renderer->drawn_depth = depth;
+	renderer->fog_weights = (Uint16*) arena_alloc(&renderer->arena, (depth + 1) * sizeof(Uint16));
+	unsigned int distance;
+	for (distance = 0; distance <= depth; ++distance) {
+		float fog = (distance - fog_start) / (fog_end - fog_start);
+		fog = (fog < 0) ? 0 : (fog > 1) ? 1 : fog;
+		renderer->fog_weights[distance] = (Uint16) (256 * increasing_interpolant(fog) + .5);
+	}
+
+	// See build_sky_rows
+	renderer->sky_height = 0;
+	renderer->sky_rows = NULL;
+
+	// Voxel rows are for distances 2 to depth inclusive
+	const size_t voxel_count = (size_t) (depth - 1) * renderer->rectangles_per_row;
+	renderer->voxel_colours = (Uint32*) arena_alloc(&renderer->arena, voxel_count * sizeof(Uint32));
+	renderer->voxel_tops = (int*) arena_alloc(&renderer->arena, voxel_count * sizeof(int));
+
+	// Several strips per thread evens out the load between threads
+	renderer->strip_count = (thread_count + 1) * TERRAIN_STRIPS_PER_THREAD;
+	if (renderer->strip_count > width)
+		renderer->strip_count = width;
+	const unsigned int strip_width = (width + renderer->strip_count - 1) / renderer->strip_count;
+
+	renderer->strips = (struct terrain_strip*) arena_calloc(&renderer->arena, renderer->strip_count, sizeof(struct terrain_strip));
+	unsigned int strip_idx;
+	for (strip_idx = 0; strip_idx < renderer->strip_count; ++strip_idx) {
+		struct terrain_strip *strip = &renderer->strips[strip_idx];
+		strip->first_column = strip_idx * strip_width;
+		strip->end_column = strip->first_column + strip_width;
+		if (strip->first_column > width)
+			strip->first_column = width;
+		if (strip->end_column > width)
+			strip->end_column = width;
+		// Each strip's y-buffer is written by a different thread
+		strip->y_buffer = (int*) arena_alloc(&renderer->arena, strip_width * sizeof(int) + TERRAIN_Y_BUFFER_PADDING);
+	}
+
+	start_thread_pool(&renderer->pool, thread_count);
+};
+
+void free_terrain_renderer(struct terrain_renderer *renderer) {
+	stop_thread_pool(&renderer->pool);
+
+	free_arena(&renderer->arena);
+	free(renderer->sky_rows);
+	renderer->sky_rows = NULL;
+};
+
+void build_sky_rows(struct terrain_renderer *renderer, unsigned int height) {
+	/*
+	 * The sky colour of every row of the target. Terrain infinitely far away
+	 * would be drawn on the middle row, so that's the horizon.
+	 */
+	renderer->sky_rows = (Uint32*) realloc(renderer->sky_rows, height * sizeof(Uint32));
+	renderer->sky_height = height;
+
+	const Uint32 zenith = colour_to_pixel(hex_to_colour(TERRAIN_SKY_ZENITH));
+	const Uint32 horizon = colour_to_pixel(hex_to_colour(TERRAIN_SKY_HORIZON));
+	const unsigned int horizon_row = height / 2;
+
+	unsigned int y;
+	for (y = 0; y < height; ++y) {
+		unsigned int weight = (y < horizon_row) ? (256 * y) / horizon_row : 256;
+		renderer->sky_rows[y] = blend_pixels(zenith, horizon, weight);
+	}
+};
+
+float shade_voxel(const struct vector *gradient) {
+	/*
+	 * Lambertian lighting, relative to that of flat terrain. The surface
+	 * normal is (-dz/dx, -dz/dy, 1) in world units.
+	 */
+	const float normal_x = -gradient->x * TERRAIN_ELEVATION_SCALE;
+	const float normal_y = -gradient->y * TERRAIN_ELEVATION_SCALE;
+	const float lit = (normal_x * TERRAIN_LIGHT_X + normal_y * TERRAIN_LIGHT_Y + TERRAIN_LIGHT_Z)
+		/ sqrtf(normal_x * normal_x + normal_y * normal_y + 1);
+
+	return TERRAIN_AMBIENT + (1 - TERRAIN_AMBIENT) * fmaxf(lit, 0) / TERRAIN_LIGHT_Z;
+};
+
+void sample_voxel_rows(void *context, unsigned int task) {
+	/*
+	 * First pass: elevation, colour and projected top edge of every voxel in
+	 * a few rows in front of the camera.
+	 */
+	struct terrain_renderer *renderer = (struct terrain_renderer*) context;
+	const struct vector *position = &renderer->camera;
+	const unsigned int rectangles_per_row = renderer->rectangles_per_row;
+
+	const struct vector forward = renderer->forward;
+	const struct vector right = renderer->right;
+
+	float row_offsets[rectangles_per_row];
+	float row_x[rectangles_per_row];
+	float row_y[rectangles_per_row];
+	float row_elevations[rectangles_per_row];
+	struct vector row_gradients[rectangles_per_row];
+
+	// How far to the right of the camera each rectangle is
+	unsigned int rectangle_idx;
+	for (rectangle_idx=0; rectangle_idx<rectangles_per_row; ++rectangle_idx)
+		row_offsets[rectangle_idx] = (float) rectangle_idx - (float) (rectangles_per_row/2);
+
+	unsigned int first_distance = 2 + task * TERRAIN_ROWS_PER_TASK;
+	unsigned int end_distance = first_distance + TERRAIN_ROWS_PER_TASK;
+	if (end_distance > renderer->drawn_depth + 1)
+		end_distance = renderer->drawn_depth + 1;
+	const Uint32 fog_colour = colour_to_pixel(hex_to_colour(TERRAIN_SKY_HORIZON));
+
+	unsigned int distance;
+	for (distance=first_distance; distance < end_distance; ++distance) {
+		// Rows are square to the camera's heading, whichever way it faces
+		for (rectangle_idx=0; rectangle_idx<rectangles_per_row; ++rectangle_idx) {
+			row_x[rectangle_idx] = position->x + row_offsets[rectangle_idx] * right.x + distance * forward.x;
+			row_y[rectangle_idx] = position->y + row_offsets[rectangle_idx] * right.y + distance * forward.y;
+		}
+
+		sample_elevations(renderer->map, rectangles_per_row, row_x, row_y, row_elevations);
+		if (renderer->shading)
+			sample_gradients(renderer->map, rectangles_per_row, row_x, row_y, row_gradients);
+
+		const size_t row_offset = (size_t) (distance - 2) * rectangles_per_row;
+		const unsigned int fog_weight = renderer->fog_weights[distance];
+		for (rectangle_idx=0; rectangle_idx<rectangles_per_row; ++rectangle_idx) {
+			float rectangle_elevation = row_elevations[rectangle_idx];
+
+			//TODO draw gradients instead of single-colour rectangles
+			Uint32 colour = elevation_to_pixel(renderer->map->colour_ramp, rectangle_elevation);
+			if (renderer->shading)
+				colour = shade_pixel(colour, shade_voxel(&row_gradients[rectangle_idx]));
+			// A voxel is the same distance away all over, and so is its fog
+			colour = blend_pixels(colour, fog_colour, fog_weight);
+			renderer->voxel_colours[row_offset + rectangle_idx] = colour;
+
+			//TODO figure out how to sensibly scale elevations
+			rectangle_elevation *= TERRAIN_ELEVATION_SCALE;
+
+			float vox_y = ((rectangle_elevation-renderer->camera_z) * TERRAIN_PROJECTION_DISTANCE)/distance;
+			renderer->voxel_tops[row_offset + rectangle_idx] = (int) -(vox_y) + (renderer->target->height/2);
+		}
+	}
+};
+
+void draw_terrain_strip(void *context, unsigned int task) {
+	/*
+	 * Second pass: rasterise the voxels that overlap a strip of columns of
+	 * the target.
+	 *
+	 * Every voxel extends all the way down to the bottom of the target, so
+	 * drawing them front to back, we only ever need to paint the part of a
+	 * column that's above whatever's been drawn in it so far. The y-buffer
+	 * tracks the topmost painted row of every column in the strip.
+	 */
+	struct terrain_renderer *renderer = (struct terrain_renderer*) context;
+	const struct terrain_strip *strip = &renderer->strips[task];
+	struct pixel_buffer *target = renderer->target;
+	const unsigned int rectangles_per_row = renderer->rectangles_per_row;
+	const int target_w = target->width;
+	const int first_column = strip->first_column;
+	const int end_column = strip->end_column;
+	int *y_buffer = strip->y_buffer;
+
+	int column;
+	for (column = first_column; column < end_column; ++column)
+		y_buffer[column - first_column] = target->height;
+
+	unsigned int distance, rectangle_idx;
+	for (distance=2; distance <= renderer->drawn_depth; ++distance) {
+		const size_t row_offset = (size_t) (distance - 2) * rectangles_per_row;
+		const int voxel_w = (int) ((float) target_w/rectangles_per_row) * TERRAIN_PROJECTION_DISTANCE / distance;
+
+		// Where neighbours overlap, the rightmost voxel is in front
+		for (rectangle_idx=rectangles_per_row; rectangle_idx-- > 0;) {
+			float vox_x = (((float) rectangle_idx - (float) (rectangles_per_row/2)) * TERRAIN_PROJECTION_DISTANCE) / distance;
+			int left = (int) (vox_x) + (target_w/2);
+			int right = left + voxel_w;
+			if (right <= first_column || left >= end_column)
+				continue;
+			if (left < first_column)
+				left = first_column;
+			if (right > end_column)
+				right = end_column;
+
+			int top = renderer->voxel_tops[row_offset + rectangle_idx];
+			if (top < 0)
+				top = 0;
+			const Uint32 pixel = renderer->voxel_colours[row_offset + rectangle_idx];
+
+			for (column = left; column < right; ++column) {
+				int *column_top = &y_buffer[column - first_column];
+				int y;
+				for (y = top; y < *column_top; ++y)
+					target->pixels[(size_t) y * target_w + column] = pixel;
+				if (top < *column_top)
+					*column_top = top;
+			}
+		}
+	}
+
+	// Whatever's left above the terrain is sky, a row at a time
+	const Uint32 *sky_rows = renderer->sky_rows;
+	int sky_bottom = 0;
+	for (column = first_column; column < end_column; ++column)
+		if (y_buffer[column - first_column] > sky_bottom)
+			sky_bottom = y_buffer[column - first_column];
+
+	int y;
+	for (y = 0; y < sky_bottom; ++y) {
+		Uint32 *row = &target->pixels[(size_t) y * target_w];
+		for (column = first_column; column < end_column; ++column)
+			if (y < y_buffer[column - first_column])
+				row[column] = sky_rows[y];
+	}
+};
+
+void render_terrain(struct terrain_renderer *renderer, struct pixel_buffer *target, const struct elevation_map *map, const struct vector *position) {
+	/*
+	 * In most 3D projection examples, the workflow involves the conversion of
+	 * a 3D vertex to a 2D pixel on the rendering surface. In these scenarios,
+	 * it is implicit that we iterate on a collection of 3D vertices coming
+	 * from some data source.
+	 * Here, however, we need to scan the map in front of the camera, derive
+	 * the elevation from the map's coordinates, *then* project that vertex.
+	 *
+	 * We'll scan a rectangle rectangles_per_row map-units wide and depth map-
+	 * units deep.
+	 *
+	 * The rectangles are laid out at whole-unit offsets *relative to the
+	 * camera*, along and across its heading, and the camera may itself be
+	 * anywhere between two map units. Their elevations are therefore
+	 * interpolated from the cached map, and the terrain glides under the
+	 * camera instead of jumping a unit at a time.
+	 *
+	 * Both passes are spread over the renderer's thread pool: rows of voxels
+	 * for the first, strips of columns of the target for the second.
+	 */
+	renderer->target = target;
+	renderer->map = map;
+	renderer->camera = *position;
+	renderer->forward = (struct vector) { .x = sinf(renderer->heading), .y = -cosf(renderer->heading) };
+	renderer->right = (struct vector) { .x = cosf(renderer->heading), .y = sinf(renderer->heading) };
+	if (renderer->sky_height != target->height)
+		build_sky_rows(renderer, target->height);
+
+	/*
+	 * Nothing past the fog is sampled or drawn, as long as the camera is
+	 * high enough that it can't tell. Any lower, and fogged ridges can rise
+	 * above the horizon, where they'd stand out against the sky.
+	 */
+	renderer->drawn_depth = (renderer->camera_z > TERRAIN_ELEVATION_SCALE) ? renderer->visible_depth : renderer->depth;
+	const unsigned int row_tasks = (renderer->drawn_depth - 1 + TERRAIN_ROWS_PER_TASK - 1) / TERRAIN_ROWS_PER_TASK;
+	run_on_thread_pool(&renderer->pool, sample_voxel_rows, renderer, row_tasks);
+	run_on_thread_pool(&renderer->pool, draw_terrain_strip, renderer, renderer->strip_count);
+};
+
+void render_top_down_map(struct pixel_buffer *target, const struct elevation_map *map, const struct vector *camera) {
+	unsigned int map_left_x, map_top_y;
+
+	if (camera->x < target->width/2)
+		map_left_x = 0;
+	else
+		map_left_x = camera->x - (target->width/2);
+
+	if (camera->y < target->height/2)
+		map_top_y = 0;
+	else
+		map_top_y = camera->y - (target->height/2);
+
+	float row_x[target->width];
+	float row_y[target->width];
+	float row_elevations[target->width];
+	unsigned int surf_x, surf_y;
+	for (surf_x = 0; surf_x < target->width; ++surf_x)
+		row_x[surf_x] = map_left_x + surf_x;
+
+	for (surf_y = 0; surf_y < target->height; ++surf_y) {
+		for (surf_x = 0; surf_x < target->width; ++surf_x)
+			row_y[surf_x] = map_top_y + surf_y;
+		sample_elevations(map, target->width, row_x, row_y, row_elevations);
+
+		for (surf_x = 0; surf_x < target->width; ++surf_x)
+			target->pixels[surf_y * target->width + surf_x] = elevation_to_pixel(map->colour_ramp, row_elevations[surf_x]);
+	}
+
+	// Mark the camera's position
+	SDL_Rect camera_rect = {
+		.x = camera->x - map_left_x - 1,
+		.y = camera->y - map_top_y - 1,
+		.w = 2,
+		.h = 2,
+	};
+	fill_pixel_rect(target, &camera_rect, colour_to_pixel(hex_to_colour(0xFF0000)));
+};
@@ -0,0 +1,122 @@
+#ifndef TERRAIN_RENDER_H
+#define TERRAIN_RENDER_H
+
+#include <stdbool.h>
+
+#include "SDL.h"
+
+#include "arena.h"
+#include "noise.h"
+#include "thread_pool.h"
+
+// These are quantities expressed in 3D world units and must therefore be
+// consistent and sensible
+#define TERRAIN_PROJECTION_DISTANCE	100
+// In the "Mars" demo, the camera is always a fixed offset above the terrain.
+// This is the default for the renderer's camera_z
+#define TERRAIN_CAMERA_Z			120
+// Elevations are 0 <= elevation <= 1, the terrain is this high
+#define TERRAIN_ELEVATION_SCALE		100
+
+/*
+ * Unit vector towards the sun: high up, ahead and to the left of a camera
+ * looking north. Flat terrain is drawn in its ramp colour, slopes facing the
+ * sun brighter and slopes facing away darker, down to TERRAIN_AMBIENT.
+ */
+#define TERRAIN_LIGHT_X				-0.48
+#define TERRAIN_LIGHT_Y				-0.60
+#define TERRAIN_LIGHT_Z				0.64
+#define TERRAIN_AMBIENT				0.4
+
+/*
+ * The sky goes from the zenith colour at the top of the target to the
+ * horizon colour at the horizon, and fog fades terrain into the horizon
+ * colour between these fractions of the view depth. As long as the camera
+ * is higher than TERRAIN_ELEVATION_SCALE, terrain never rises above the
+ * horizon, so there's no telling fully fogged terrain from the sky and it
+ * isn't drawn at all. Lower cameras draw all the way to the view depth.
+ */
+#define TERRAIN_SKY_ZENITH			0x3A7BD5
+#define TERRAIN_SKY_HORIZON			0xB9D7F7
+#define TERRAIN_FOG_START			0.3
+#define TERRAIN_FOG_END				0.9
+
+// TODO Should we just use the target's width?
+#define TERRAIN_RECTANGLES_PER_ROW	100
+
+// How terrain rendering is split between threads
+#define TERRAIN_ROWS_PER_TASK		16
+#define TERRAIN_STRIPS_PER_THREAD	4
+// Keeps the strips' y-buffers on separate cache lines
+#define TERRAIN_Y_BUFFER_PADDING	64
+
+// ARGB8888 pixels
+struct pixel_buffer {
+	unsigned int width;
+	unsigned int height;
+	Uint32 *pixels;
+};
+
+// A range of columns of the target and its scratch space
+struct terrain_strip {
+	unsigned int first_column;
+	unsigned int end_column;
+	int *y_buffer;
+};
+
+struct terrain_renderer {
+	struct thread_pool pool;
+	// Everything that lives as long as the renderer, bar the sky rows
+	struct arena arena;
+	unsigned int depth;
+	float camera_z;
+	// Radians clockwise from north, ie. from looking towards -y
+	float heading;
+	unsigned int rectangles_per_row;
+	unsigned int strip_count;
+	struct terrain_strip *strips;
+	// Light the terrain with the map's gradients, see shade_voxel
+	bool shading;
+
+	// Voxels beyond visible_depth are lost in the fog
+	unsigned int visible_depth;
+	// How far the current frame goes, see render_terrain
+	unsigned int drawn_depth;
+	// Fog for every distance up to depth, out of 256
+	Uint16 *fog_weights;
+	// Sky colour for every row of a target sky_height pixels high
+	unsigned int sky_height;
+	Uint32 *sky_rows;
+
+	// One row of voxels for every distance from the camera
+	Uint32 *voxel_colours;
+	int *voxel_tops;
+
+	// What's being rendered at the moment
+	struct pixel_buffer *target;
+	const struct elevation_map *map;
+	struct vector camera;
+	// Unit vectors ahead of and to the right of the camera, from heading
+	struct vector forward;
+	struct vector right;
+};
+
+void fill_pixel_rect(struct pixel_buffer*, const SDL_Rect*, Uint32);
+
+void init_terrain_renderer(struct terrain_renderer*, unsigned int, unsigned int, unsigned int);
+
+void free_terrain_renderer(struct terrain_renderer*);
+
+float shade_voxel(const struct vector*);
+
+void build_sky_rows(struct terrain_renderer*, unsigned int);
+
+void sample_voxel_rows(void*, unsigned int);
+
+void draw_terrain_strip(void*, unsigned int);
+
+void render_terrain(struct terrain_renderer*, struct pixel_buffer*, const struct elevation_map*, const struct vector*);
+
+void render_top_down_map(struct pixel_buffer*, const struct elevation_map*, const struct vector*);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+
+#include "thread_pool.h"
+
+void thread_pool_worker_loop(struct thread_pool *pool) {
+	// Called with the pool's lock held, returns with it held
+	while (pool->next_task < pool->task_count) {
+		unsigned int task = pool->next_task++;
+		SDL_UnlockMutex(pool->lock);
+		pool->job(pool->context, task);
+		SDL_LockMutex(pool->lock);
+
+		if (++pool->finished_tasks == pool->task_count)
+			SDL_CondBroadcast(pool->work_done);
+	}
+};
+
+int thread_pool_worker(void *data) {
+	struct thread_pool *pool = (struct thread_pool*) data;
+
+	SDL_LockMutex(pool->lock);
+	while (!pool->stopping) {
+		thread_pool_worker_loop(pool);
+		SDL_CondWait(pool->work_ready, pool->lock);
+	}
+	SDL_UnlockMutex(pool->lock);
+	return 0;
+};
+
+void start_thread_pool(struct thread_pool *pool, unsigned int thread_count) {
+	*pool = (struct thread_pool) {
+		.thread_count = thread_count,
+		.threads = (SDL_Thread**) calloc(thread_count, sizeof(SDL_Thread*)),
+		.lock = SDL_CreateMutex(),
+		.work_ready = SDL_CreateCond(),
+		.work_done = SDL_CreateCond(),
+		.stopping = false,
+	};
+
+	unsigned int thread_idx;
+	for (thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+		pool->threads[thread_idx] = SDL_CreateThread(thread_pool_worker, "thread_pool", pool);
+};
+
+void run_on_thread_pool(struct thread_pool *pool, void (*job)(void*, unsigned int), void *context, unsigned int task_count) {
+	/*
+	 * The calling thread takes its share of the tasks too, so a pool with no
+	 * threads at all just runs everything in sequence.
+	 */
+	SDL_LockMutex(pool->lock);
+	pool->job = job;
+	pool->context = context;
+	pool->task_count = task_count;
+	pool->next_task = 0;
+	pool->finished_tasks = 0;
+	SDL_CondBroadcast(pool->work_ready);
+
+	thread_pool_worker_loop(pool);
+	while (pool->finished_tasks < pool->task_count)
+		SDL_CondWait(pool->work_done, pool->lock);
+
+	pool->task_count = pool->next_task = 0;
+	SDL_UnlockMutex(pool->lock);
+};
+
+void stop_thread_pool(struct thread_pool *pool) {
+	SDL_LockMutex(pool->lock);
+	pool->stopping = true;
+	SDL_CondBroadcast(pool->work_ready);
+	SDL_UnlockMutex(pool->lock);
+
+	unsigned int thread_idx;
+	for (thread_idx = 0; thread_idx < pool->thread_count; ++thread_idx)
+		SDL_WaitThread(pool->threads[thread_idx], NULL);
+
+	SDL_DestroyCond(pool->work_done);
+	SDL_DestroyCond(pool->work_ready);
+	SDL_DestroyMutex(pool->lock);
+	free(pool->threads);
+};
@@ -0,0 +1,36 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+
+#include "SDL.h"
+
+/*
+ * Runs task_count calls to job(context, task_idx) across a fixed set of
+ * threads
+ */
+struct thread_pool {
+	unsigned int thread_count;
+	SDL_Thread **threads;
+	SDL_mutex *lock;
+	SDL_cond *work_ready;
+	SDL_cond *work_done;
+	void (*job)(void*, unsigned int);
+	void *context;
+	unsigned int task_count;
+	unsigned int next_task;
+	unsigned int finished_tasks;
+	bool stopping;
+};
+
+void thread_pool_worker_loop(struct thread_pool*);
+
+int thread_pool_worker(void*);
+
+void start_thread_pool(struct thread_pool*, unsigned int);
+
+void run_on_thread_pool(struct thread_pool*, void (*)(void*, unsigned int), void*, unsigned int);
+
+void stop_thread_pool(struct thread_pool*);
+
+#endif
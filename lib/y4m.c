@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "y4m.h"
+
+void argb_to_yuv420(const Uint32 * restrict pixels, unsigned int width, unsigned int height, unsigned int pitch, Uint8 * restrict y_plane, Uint8 * restrict u_plane, Uint8 * restrict v_plane) {
+	/*
+	 * Fixed point BT.601, full range, with every 2x2 block of pixels sharing
+	 * its averaged chroma. The width and height must be even. There's no
+	 * branching and no lookup in the inner loop, so that the compiler can
+	 * vectorise it.
+	 */
+	const unsigned int chroma_width = width / 2;
+	unsigned int row, chroma_x;
+	for (row = 0; row < height; row += 2) {
+		const Uint32 * restrict top = pixels + (size_t) row * pitch;
+		const Uint32 * restrict bottom = top + pitch;
+		Uint8 * restrict y_top = y_plane + (size_t) row * width;
+		Uint8 * restrict y_bottom = y_top + width;
+		Uint8 * restrict u_row = u_plane + (size_t) (row / 2) * chroma_width;
+		Uint8 * restrict v_row = v_plane + (size_t) (row / 2) * chroma_width;
+
+		for (chroma_x = 0; chroma_x < chroma_width; ++chroma_x) {
+			const Uint32 quad[4] = {
+				top[2 * chroma_x], top[2 * chroma_x + 1],
+				bottom[2 * chroma_x], bottom[2 * chroma_x + 1],
+			};
+			int red[4], green[4], blue[4];
+			unsigned int quad_idx;
+			for (quad_idx = 0; quad_idx < 4; ++quad_idx) {
+				red[quad_idx] = (quad[quad_idx] >> 16) & 0xFF;
+				green[quad_idx] = (quad[quad_idx] >> 8) & 0xFF;
+				blue[quad_idx] = quad[quad_idx] & 0xFF;
+			}
+
+			// The weights add up to 256, so Y can't overflow
+#define LUMA(i) ((Uint8) ((77 * red[i] + 150 * green[i] + 29 * blue[i] + 128) >> 8))
+			y_top[2 * chroma_x] = LUMA(0);
+			y_top[2 * chroma_x + 1] = LUMA(1);
+			y_bottom[2 * chroma_x] = LUMA(2);
+			y_bottom[2 * chroma_x + 1] = LUMA(3);
+#undef LUMA
+
+			// Sums of four, hence the extra 2 bits of shift
+			const int red_sum = red[0] + red[1] + red[2] + red[3];
+			const int green_sum = green[0] + green[1] + green[2] + green[3];
+			const int blue_sum = blue[0] + blue[1] + blue[2] + blue[3];
+			const int u = (-43 * red_sum - 85 * green_sum + 128 * blue_sum + (128 << 10) + 512) >> 10;
+			const int v = (128 * red_sum - 107 * green_sum - 21 * blue_sum + (128 << 10) + 512) >> 10;
+			// Only pure blue or pure red get rounded up to 256
+			u_row[chroma_x] = (Uint8) ((u > 255) ? 255 : u);
+			v_row[chroma_x] = (Uint8) ((v > 255) ? 255 : v);
+		}
+	}
+};
+
+int y4m_writer_thread(void *data) {
+	struct y4m_writer *writer = (struct y4m_writer*) data;
+	const size_t luma_size = (size_t) writer->width * writer->height;
+	const size_t frame_size = luma_size + luma_size / 2;
+
+	SDL_LockMutex(writer->lock);
+	while (true) {
+		while (writer->written == writer->queued && !writer->stopping)
+			SDL_CondWait(writer->changed, writer->lock);
+		// Whatever was queued before stopping still gets written
+		if (writer->written == writer->queued)
+			break;
+
+		// The frame stays in the queue until it's been written
+		const Uint32 *frame = writer->frames[writer->written % Y4M_QUEUE_DEPTH];
+		SDL_UnlockMutex(writer->lock);
+
+		argb_to_yuv420(
+			frame,
+			writer->width,
+			writer->height,
+			writer->width,
+			writer->planes,
+			writer->planes + luma_size,
+			writer->planes + luma_size + luma_size / 4
+		);
+		bool failed = (6 != fwrite("FRAME\n", 1, 6, writer->output))
+			|| (frame_size != fwrite(writer->planes, 1, frame_size, writer->output));
+
+		SDL_LockMutex(writer->lock);
+		writer->failed |= failed;
+		writer->written++;
+		SDL_CondBroadcast(writer->changed);
+	}
+	SDL_UnlockMutex(writer->lock);
+	return 0;
+};
+
+int start_y4m_writer(struct y4m_writer *writer, const char *path, unsigned int width, unsigned int height, unsigned int frame_rate) {
+	// "-" is stdout, so that the stream can be piped straight into an encoder
+	if (0 != width % 2 || 0 != height % 2) {
+		fprintf(stderr, "Cannot write %ux%u frames, 4:2:0 needs an even width and height\n", width, height);
+		return -1;
+	}
+	writer->output = (0 == strcmp(path, "-")) ? stdout : fopen(path, "wb");
+	if (!writer->output) {
+		fprintf(stderr, "Cannot open %s for writing\n", path);
+		return -1;
+	}
+	fprintf(writer->output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, frame_rate);
+
+	writer->width = width;
+	writer->height = height;
+	unsigned int frame_idx;
+	for (frame_idx = 0; frame_idx < Y4M_QUEUE_DEPTH; ++frame_idx)
+		writer->frames[frame_idx] = (Uint32*) malloc((size_t) width * height * sizeof(Uint32));
+	writer->planes = (Uint8*) malloc((size_t) width * height * 3 / 2);
+	writer->queued = writer->written = 0;
+	writer->stopping = writer->failed = false;
+
+	writer->lock = SDL_CreateMutex();
+	writer->changed = SDL_CreateCond();
+	writer->thread = SDL_CreateThread(y4m_writer_thread, "y4m_writer", writer);
+	return 0;
+};
+
+int write_y4m_frame(struct y4m_writer *writer, const Uint32 *pixels, unsigned int pitch) {
+	/*
+	 * Copies a width x height frame, pitch pixels per row, into the queue.
+	 * Only waits for the writer if it's Y4M_QUEUE_DEPTH frames behind.
+	 */
+	SDL_LockMutex(writer->lock);
+	while (writer->queued - writer->written >= Y4M_QUEUE_DEPTH && !writer->failed)
+		SDL_CondWait(writer->changed, writer->lock);
+	bool failed = writer->failed;
+	SDL_UnlockMutex(writer->lock);
+	if (failed)
+		return -1;
+
+	// Nobody else touches a slot that isn't queued
+	Uint32 *frame = writer->frames[writer->queued % Y4M_QUEUE_DEPTH];
+	unsigned int row;
+	for (row = 0; row < writer->height; ++row)
+		memcpy(frame + (size_t) row * writer->width, pixels + (size_t) row * pitch, writer->width * sizeof(Uint32));
+
+	SDL_LockMutex(writer->lock);
+	writer->queued++;
+	SDL_CondBroadcast(writer->changed);
+	SDL_UnlockMutex(writer->lock);
+	return 0;
+};
+
+int stop_y4m_writer(struct y4m_writer *writer) {
+	SDL_LockMutex(writer->lock);
+	writer->stopping = true;
+	SDL_CondBroadcast(writer->changed);
+	SDL_UnlockMutex(writer->lock);
+	SDL_WaitThread(writer->thread, NULL);
+
+	SDL_DestroyCond(writer->changed);
+	SDL_DestroyMutex(writer->lock);
+
+	int status = writer->failed ? -1 : 0;
+	if (0 != fflush(writer->output))
+		status = -1;
+	if (stdout != writer->output && 0 != fclose(writer->output))
+		status = -1;
+	if (0 != status)
+		fprintf(stderr, "Failed to write the video stream\n");
+
+	unsigned int frame_idx;
+	for (frame_idx = 0; frame_idx < Y4M_QUEUE_DEPTH; ++frame_idx)
+		free(writer->frames[frame_idx]);
+	free(writer->planes);
+	return status;
+};
@@ -0,0 +1,46 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "SDL.h"
+
+// Frames waiting to be converted and written, on top of the one being written
+#define Y4M_QUEUE_DEPTH		3
+
+/*
+ * Writes ARGB8888 frames out as a YUV4MPEG2 stream of 4:2:0 frames, full
+ * range BT.601 (C420jpeg), which ffmpeg, mpv and friends read as is. The
+ * conversion and the writing happen on the writer's own thread: frames are
+ * copied into a queue and the caller only waits when the queue is full.
+ */
+struct y4m_writer {
+	FILE *output;
+	unsigned int width;
+	unsigned int height;
+	// ARGB copies of the queued frames
+	Uint32 *frames[Y4M_QUEUE_DEPTH];
+	// The converted frame: Y, then U and V at half the resolution
+	Uint8 *planes;
+	// Running frame counts, the queue slot is the count modulo Y4M_QUEUE_DEPTH
+	unsigned int queued;
+	unsigned int written;
+	bool stopping;
+	bool failed;
+	SDL_mutex *lock;
+	SDL_cond *changed;
+	SDL_Thread *thread;
+};
+
+void argb_to_yuv420(const Uint32*, unsigned int, unsigned int, unsigned int, Uint8*, Uint8*, Uint8*);
+
+int y4m_writer_thread(void*);
+
+int start_y4m_writer(struct y4m_writer*, const char*, unsigned int, unsigned int, unsigned int);
+
+int write_y4m_frame(struct y4m_writer*, const Uint32*, unsigned int);
+
+int stop_y4m_writer(struct y4m_writer*);
+
+#endif
@@ -1,13 +1,30 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include <assert.h>
 
 #include "SDL.h"
 
+#include "frame_clock.h"
+#include "noise.h"
+#include "noise_volume.h"
+#include "thread_pool.h"
+
 #define NOISE_WIDTH		200
 #define NOISE_HEIGHT	200
+#define NOISE_STEP		25
 
-#define M_PI			3.14159265358979323846
+// Animated noise, see draw_animated_noise
+#define NOISE_ANIMATED_STEP		100
+#define NOISE_PERIOD			16
+#define NOISE_TICK_RATE			60
+// Lattice units of time per simulation tick
+#define NOISE_TIME_PER_TICK		1.5
+#define NOISE_ROWS_PER_TASK		16
+// 3D noise has a narrower spread than 2D noise, so it's scaled up more
+#define NOISE_ANIMATED_SCALE	256
 
 
 void prepare_colour_gradient(SDL_Palette *noise_palette) {
@@ -20,32 +37,6 @@ void prepare_colour_gradient(SDL_Palette *noise_palette) {
 	}
 };
 
-struct vector {
-	// TODO Use ints
-	float x;
-	float y;
-};
-
-void random_unit_vector(struct vector *dest) {
-	float angle = ((float) rand() * 2 * M_PI) /  (RAND_MAX);
-	dest->x = cos(angle);
-	dest->y = sin(angle);
-};
-
-float ease(float x) {
-	return 3 * pow(x, 2) - 2 * pow(x, 3);
-}
-
-float dot_product(const struct vector *lhs, const struct vector *rhs) {
-	/*
-	 * For each vector, we have -1 <= x <= 1 (within a cell of the grid)
-	 * or -surface->width <= x <= surface->width
-	 * the product is 
-	 * -2 width^2 <=prod <= 2 width^2
-	 */
-	return (lhs->x * rhs->x) + (lhs->y * rhs->y);
-};
-
 void draw_noise(SDL_Surface *surface, const unsigned int step) {
 	/*
 	 * So... The FAQ says that we need to overlay a grid in which
@@ -63,81 +54,155 @@ void draw_noise(SDL_Surface *surface, const unsigned int step) {
 	assert(surface->w == surface->h);
 	assert((surface->w) % step == 0);
 
-	const unsigned int nodes_per_side = 1 + (surface->w / step);
-
 	// There'll be (surface->side/step + 1) ^ 2 nodes in the grid
-	struct vector *node_vectors = (struct vector*) calloc(nodes_per_side * nodes_per_side, sizeof(struct vector));
-
-	// Would be nice if there were a nicer way that doesn't rely on integer counters
-	unsigned int node_x, node_y;
-	for(node_y = 0; node_y < nodes_per_side; ++node_y)
-		for(node_x = 0; node_x < nodes_per_side; ++node_x)
-			random_unit_vector(&node_vectors[node_y * nodes_per_side + node_x]);
-
-	// We need to iterate on the corners of the surface/nodes on the grid
-	// OR DO WE? We're going to need to paint every pixel of the surface, for
-	// each we need to know the cell it belongs to and the four corners of the
-	// cell
-	struct vector *node_above_left;
-	struct vector *node_above_right;
-	struct vector *node_below_left;
-	struct vector *node_below_right;
-
-	struct vector from_above_left;
-	struct vector from_above_right;
-	struct vector from_below_left;
-	struct vector from_below_right;
-
-	unsigned int segment_x, segment_y;
+	struct elevation_map lattice = {
+		.width = surface->w,
+		.height = surface->h,
+		.step = step,
+		.colour_ramp = NULL,
+		.node_vectors = NULL,
+		.elevations = NULL,
+	};
+	create_noise_vectors(&lattice);
+
+	float row_noise[surface->w];
 	unsigned int x, y;
 	for(y=0; y < surface->h; ++y) {
-		segment_y = y / step;
+		get_map_row_noise(&lattice, 0, y, surface->w, row_noise);
 
 		for(x=0; x < surface->w; ++x) {
-			segment_x = x / step;
+			unsigned int noise_idx = (unsigned int) 128 + (row_noise[x] * 128);
+			((Uint8*) surface->pixels)[y * surface->w + x] = (Uint8) noise_idx;
+		}
+	}
+	free_elevation_map(&lattice);
+};
 
-			node_above_left = &node_vectors[segment_y * nodes_per_side + segment_x];
-			node_above_right = &node_vectors[segment_y * nodes_per_side + segment_x + 1];
-			node_below_left = &node_vectors[(segment_y + 1) * nodes_per_side + segment_x];
-			node_below_right = &node_vectors[(segment_y + 1) * nodes_per_side + (segment_x + 1)];
 
-			unsigned int node_left_x = segment_x * step;
-			unsigned int node_right_x = node_left_x + step;
-			unsigned int node_above_y = segment_y * step;
-			unsigned int node_below_y = node_above_y + step;
+/*
+ * One frame of animated noise: a horizontal slice of the noise volume at a
+ * given time, drawn into an INDEX8 surface a band of rows per task
+ */
+struct noise_frame {
+	const struct noise_volume *volume;
+	SDL_Surface *surface;
+	float time;
+};
 
-			from_below_left.x = ((float) x - node_left_x) / step;
-			from_below_left.y = ((float) y - node_below_y) / step;
+void draw_noise_rows(void *context, unsigned int task_idx) {
+	const struct noise_frame *frame = (const struct noise_frame*) context;
+	SDL_Surface *surface = frame->surface;
 
-			from_below_right.x = ((float) x - node_right_x) / step;
-			from_below_right.y = ((float) y - node_below_y) / step;
+	unsigned int first_row = task_idx * NOISE_ROWS_PER_TASK;
+	unsigned int end_row = first_row + NOISE_ROWS_PER_TASK;
+	if (end_row > surface->h)
+		end_row = surface->h;
 
-			from_above_left.x = ((float) x - node_left_x) / step;
-			from_above_left.y = ((float) y - node_above_y) / step;
+	float row_noise[surface->w];
+	unsigned int x, y;
+	for (y = first_row; y < end_row; ++y) {
+		get_volume_row_noise(frame->volume, 0, y, frame->time, surface->w, row_noise);
+
+		Uint8 *pixels = (Uint8*) surface->pixels + y * surface->pitch;
+		for (x = 0; x < surface->w; ++x) {
+			float noise_idx = 128 + row_noise[x] * NOISE_ANIMATED_SCALE;
+			noise_idx = (noise_idx < 0) ? 0 : noise_idx;
+			noise_idx = (noise_idx > 254) ? 254 : noise_idx;
+			pixels[x] = (Uint8) noise_idx;
+		}
+	}
+};
 
-			from_above_right.x = ((float) x - node_right_x) / step;
-			from_above_right.y = ((float) y - node_above_y) / step;
+void draw_animated_noise(struct thread_pool *pool, const struct noise_volume *volume, SDL_Surface *surface, float time) {
+	struct noise_frame frame = {
+		.volume = volume,
+		.surface = surface,
+		.time = time,
+	};
+	unsigned int task_count = (surface->h + NOISE_ROWS_PER_TASK - 1) / NOISE_ROWS_PER_TASK;
+	run_on_thread_pool(pool, draw_noise_rows, &frame, task_count);
+};
 
-			float s = dot_product(node_below_left, &from_below_left);
-			float t = dot_product(node_below_right, &from_below_right);
-			float u = dot_product(node_above_left, &from_above_left);
-			float v = dot_product(node_above_right, &from_above_right);
+int animate_noise(SDL_Renderer *renderer, SDL_Surface *noise_surface, unsigned int step, int refresh_rate) {
+	/*
+	 * The noise volume has time as its third axis. The volume must cover the
+	 * surface in whole cells, so it may stick out to the right and bottom.
+	 */
+	struct noise_volume volume = {
+		.width = step * ((noise_surface->w + step - 1) / step),
+		.height = step * ((noise_surface->h + step - 1) / step),
+		.step = step,
+		.period = NOISE_PERIOD,
+		.node_vectors = NULL,
+	};
+	create_noise_volume(&volume);
+
+	// Extra threads on top of this one
+	int cpu_count = SDL_GetCPUCount();
+	struct thread_pool pool;
+	start_thread_pool(&pool, (cpu_count > 1) ? cpu_count - 1 : 0);
 
-			float sx_weight = ease(from_above_left.x);
-			float a = s + sx_weight*(t-s);
-			float b = u + sx_weight*(v-u);
+	/*
+	 * The INDEX8 surface goes through an ARGB one on its way to a streaming
+	 * texture, rather than creating a texture from it for every frame
+	 */
+	SDL_Surface *argb_surface = SDL_CreateRGBSurfaceWithFormat(
+		0,
+		noise_surface->w,
+		noise_surface->h,
+		32,
+		SDL_PIXELFORMAT_ARGB8888
+	);
+	SDL_Texture *display_texture = SDL_CreateTexture(
+		renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		noise_surface->w,
+		noise_surface->h
+	);
+	SDL_SetSurfaceBlendMode(noise_surface, SDL_BLENDMODE_NONE);
 
-			// Why the (1-X)? Well, it's because the origin of the coordinate system is on the top left.
-			float sy_weight = ease(1 - from_above_left.y);
-			float z = a + sy_weight*(b-a);
+	struct frame_clock clock;
+	frame_clock_init(&clock, NOISE_TICK_RATE, refresh_rate);
 
-			unsigned int noise_idx = (unsigned int) 128 + (z * 128);
-			((Uint8*) surface->pixels)[y * surface->w + x] = (Uint8) noise_idx;
+	bool running = true;
+	unsigned long ticks_elapsed = 0;
+	while (running) {
+		ticks_elapsed += frame_clock_advance(&clock);
+
+		// Render part of the way towards the next tick
+		float time = (ticks_elapsed + frame_clock_alpha(&clock)) * NOISE_TIME_PER_TICK;
+
+		SDL_LockSurface(noise_surface);
+		draw_animated_noise(&pool, &volume, noise_surface, time);
+		SDL_UnlockSurface(noise_surface);
+
+		SDL_BlitSurface(noise_surface, NULL, argb_surface, NULL);
+		SDL_UpdateTexture(display_texture, NULL, argb_surface->pixels, argb_surface->pitch);
+
+		SDL_RenderClear(renderer);
+		SDL_RenderCopy(renderer, display_texture, NULL, NULL);
+		SDL_RenderPresent(renderer);
+
+		SDL_Event event;
+		while (0 != SDL_PollEvent(&event)) {
+			if (SDL_QUIT == event.type)
+				running = false;
+			if (SDL_KEYDOWN == event.type) {
+				if (event.key.keysym.sym == SDLK_q)
+					running = false;
+			}
 		}
 	}
-	free(node_vectors);
-};
 
+	frame_clock_report(&clock, stdout);
+
+	SDL_DestroyTexture(display_texture);
+	SDL_FreeSurface(argb_surface);
+	stop_thread_pool(&pool);
+	free_noise_volume(&volume);
+	return EXIT_SUCCESS;
+};
 
 int main(int arg_count, char **args) {
 	SDL_Window		*window;
@@ -145,14 +210,53 @@ int main(int arg_count, char **args) {
 	SDL_Texture		*display_texture;
 	SDL_Surface		*noise_surface;
 
+	/*
+	 * --animate: noise that evolves over time, at -s WxH and with a lattice
+	 * step of -p, otherwise a still image
+	 * --uncapped: don't wait for vsync when animating
+	 */
+	bool animate = false, uncapped = false;
+	unsigned int width = NOISE_WIDTH, height = NOISE_HEIGHT;
+	unsigned int step = 0;
+	int arg_idx;
+	for (arg_idx = 1; arg_idx < arg_count; ++arg_idx) {
+		const char *value = (arg_idx + 1 < arg_count) ? args[arg_idx + 1] : NULL;
+		if (0 == strcmp(args[arg_idx], "--animate"))
+			animate = true;
+		else if (0 == strcmp(args[arg_idx], "--uncapped"))
+			uncapped = true;
+		else if (0 == strcmp(args[arg_idx], "-s") && value && 2 == sscanf(value, "%ux%u", &width, &height))
+			++arg_idx;
+		else if (0 == strcmp(args[arg_idx], "-p") && value && 1 == sscanf(value, "%u", &step) && step > 0)
+			++arg_idx;
+		else {
+			fprintf(stderr, "usage: %s [--animate [--uncapped] [-s WIDTHxHEIGHT] [-p STEP]]\n", args[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!animate)
+		width = height = NOISE_WIDTH;
+	if (!step)
+		step = animate ? NOISE_ANIMATED_STEP : NOISE_STEP;
+	// The still image's lattice has to fit it exactly, see draw_noise
+	if (!animate && 0 != NOISE_WIDTH % step) {
+		fprintf(stderr, "%s: the still image is %u wide, the step must divide that\n", args[0], NOISE_WIDTH);
+		fprintf(stderr, "usage: %s [--animate [--uncapped] [-s WIDTHxHEIGHT] [-p STEP]]\n", args[0]);
+		return EXIT_FAILURE;
+	}
+	if (!width || !height) {
+		fprintf(stderr, "%s: empty window size\n", args[0]);
+		return EXIT_FAILURE;
+	}
+
 	SDL_Init(SDL_INIT_VIDEO);
 
 	window = SDL_CreateWindow(
 		"Noise",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		NOISE_WIDTH,
-		NOISE_HEIGHT,
+		width,
+		height,
 		0
 	);
 	SDL_ShowCursor(false);
@@ -160,13 +264,13 @@ int main(int arg_count, char **args) {
 	renderer = SDL_CreateRenderer(
 		window,
 		-1,
-		SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
+		uncapped ? SDL_RENDERER_ACCELERATED : SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
 	);
 
 	SDL_Surface *rgb_surface = SDL_CreateRGBSurface(
 		0,
-		NOISE_WIDTH,
-		NOISE_HEIGHT,
+		width,
+		height,
 		32,
 		0, 0, 0, 0
 	);
@@ -178,12 +282,26 @@ int main(int arg_count, char **args) {
 	);
 	SDL_FreeSurface(rgb_surface);
 	prepare_colour_gradient(noise_surface->format->palette);
+	SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
+
+	if (animate) {
+		srand(time(NULL));
+		SDL_DisplayMode display_mode = { .refresh_rate = 0 };
+		SDL_GetWindowDisplayMode(window, &display_mode);
+
+		int status = animate_noise(renderer, noise_surface, step, display_mode.refresh_rate);
+
+		SDL_FreeSurface(noise_surface);
+		SDL_DestroyRenderer(renderer);
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		return status;
+	}
 
 	SDL_LockSurface(noise_surface);
-	draw_noise(noise_surface, 25);
+	draw_noise(noise_surface, step);
 	SDL_UnlockSurface(noise_surface);
 
-	SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
 	SDL_RenderClear(renderer);
 
 	display_texture = SDL_CreateTextureFromSurface(
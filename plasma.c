@@ -1,128 +1,131 @@
-#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "SDL.h"
 
-# define M_PI		3.14159265358979323846	/* pi */
+#include "frame_clock.h"
+#include "plasma.h"
+#include "y4m.h"
 
 #define PLASMA_WIDTH	160
 #define PLASMA_HEIGHT	90
 
-#define PALETTE_DEPTH	8
-#define PALETTE_COLOURS (1<< PALETTE_DEPTH)
+// The animation advances this many times per second, whatever the display
+#define PLASMA_TICK_RATE	60
 
-#define PLASMA_PEAK		(PALETTE_COLOURS / 2)
-#define SIN_AMPLITUDE	(PLASMA_PEAK / 4)
+// Recordings are scaled up to this size by default, and this many frames long
+#define RECORD_WIDTH		1280
+#define RECORD_HEIGHT		720
+#define RECORD_FRAMES		(60 * PLASMA_TICK_RATE)
 
-#define SIN_INDICES		256
-/* sin(-a) = -sin(a) */
-#define SIN(x) (x>=0?sin_array[x]:-sin_array[-x])
-
-static int sin_array[SIN_INDICES];
-
-void prepare_sin() {
-	unsigned int i;
-	for (i=0; i < SIN_INDICES; ++i)
-		sin_array[i] = (int) (SIN_AMPLITUDE * sin(2 * M_PI * i / SIN_INDICES));
-};
-
-void prepare_palette(SDL_Palette *plasma_palette, unsigned int time) {
-	/* The values we read from the sin curve are
-	 * -SIN_AMPLITUDE <= x <= SIN_AMPLITUDE
-	 * We use 4 points on the curve, therefore the index of a point on the
-	 * plasma surface will be:
-	 * -4*SIN_AMPLITUDE < pixel_palette_index < 4*SIN_AMPLITUDE
-	 */
-	static int redfactor = 1, greenfactor = 2, bluefactor = 3;
-	static int redphase = 0, greenphase = 50, bluephase = 100;
-
-	unsigned int red, green, blue;
-	unsigned int base_red, base_green, base_blue;
-
-	// These are the base values for index 0 of the palette
-	base_red = time * redfactor + redphase;
-	base_green = time * greenfactor + greenphase;
-	base_blue = time * bluefactor + bluephase;
+// The points on the sin curve move by these every simulation tick
+static const int sp1 = 4, sp2 = 2, sp3 = 4, sp4 = 2;
 
+int record_plasma(const char *path, unsigned int frame_count, unsigned int width, unsigned int height) {
 	/*
-	 * Ultimately, the R, G and B components in the palette must be
-	 * 0 <= r,g,b <= 255
-	 *
-	 * The red, green and blue factors derived from the time counter are
-	 * monotonically increasing quantities, type notwithstanding (ie, they'd
-	 * grow to infinity given enough bits).
-	 *
-	 * What we want is for each component value to grow from 0 to 255 and back
-	 * down to 0. The rockbox code does this by doubling the least significant
-	 * byte of the values (ie, from 0 to * 510) and subtracting values greater
-	 * than 255 from 510 to ramp down.
-	 * It's pretty clever *but* it'll only work if the variables are stored in
-	 * types that allow values greater than 255. In other words, we must cast
-	 * to Uint8 *after* the conversion and ramp-down.
+	 * No window and no clock: one simulation tick per frame, rendered and
+	 * handed to the video writer as fast as they come. The plasma is drawn
+	 * at its usual size and scaled up like the window would.
 	 */
-
-	for (unsigned int palette_idx = 0; palette_idx < PALETTE_COLOURS - 1; ++palette_idx) {
-		base_red &= 0xFF; red = 2 * base_red;
-		base_green &= 0xFF; green = 2 * base_green;
-		base_blue &= 0xFF; blue = 2 * base_blue;
-
-		if (red > 255)
-			red = 510 - red;
-		if (green > 255)
-			green = 510 - green;
-		if (blue > 255)
-			blue = 510 - blue;
-
-		plasma_palette->colors[palette_idx].r = (Uint8) red;
-		plasma_palette->colors[palette_idx].g = (Uint8) green;
-		plasma_palette->colors[palette_idx].b = (Uint8) blue;
-
-		base_red++; base_green++; base_blue++;
+	SDL_Surface *palette_surface = SDL_CreateRGBSurfaceWithFormat(
+		0,
+		PLASMA_WIDTH,
+		PLASMA_HEIGHT,
+		8,
+		SDL_PIXELFORMAT_INDEX8
+	);
+	Uint32 *pixels = (Uint32*) malloc((size_t) width * height * sizeof(Uint32));
+	unsigned int *source_columns = (unsigned int*) malloc(width * sizeof(unsigned int));
+	unsigned int x, y;
+	for (x = 0; x < width; ++x)
+		source_columns[x] = x * PLASMA_WIDTH / width;
+
+	struct y4m_writer writer;
+	if (!palette_surface || 0 != start_y4m_writer(&writer, path, width, height, PLASMA_TICK_RATE)) {
+		SDL_FreeSurface(palette_surface);
+		free(pixels);
+		free(source_columns);
+		return -1;
 	}
-};
-
-void draw_plasma_to_surface(SDL_Surface *plasma_surface, int p1, int p2, int p3, int p4) {
-	// These are used as indices on the sin curve. They may be positive or
-	// negative
-	int t1, t2, t3, t4;
 
-	int surface_row, row_offset;
-
-	int row_base_palette_index, pixel_palette_index;
-
-	t1 = p1;
-	t2 = p2;
-	for (surface_row = 0; surface_row < plasma_surface->h; ++surface_row) {
+	int p1, p2, p3, p4;
+	p1=p2=p3=p4=0;
+	int status = 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+	unsigned int frame;
+	for (frame = 0; frame < frame_count && 0 == status; ++frame) {
+		prepare_palette(palette_surface->format->palette, frame);
+		draw_plasma_to_surface(palette_surface, p1, p2, p3, p4);
+		p1 += sp1;
+		p2 -= sp2;
+		p3 += sp3;
+		p4 -= sp4;
 
-		// XXX Why do we reset t3 and t4 for every row?
-		t3 = p3;
-		t4 = p4;
+		Uint32 palette[PALETTE_COLOURS];
+		const SDL_Color *colours = palette_surface->format->palette->colors;
+		unsigned int palette_idx;
+		for (palette_idx = 0; palette_idx < PALETTE_COLOURS; ++palette_idx)
+			palette[palette_idx] = (colours[palette_idx].r << 16) | (colours[palette_idx].g << 8) | colours[palette_idx].b;
+
+		for (y = 0; y < height; ++y) {
+			const Uint8 *source_row = (const Uint8*) palette_surface->pixels + palette_surface->pitch * (y * PLASMA_HEIGHT / height);
+			Uint32 *row = pixels + (size_t) y * width;
+			for (x = 0; x < width; ++x)
+				row[x] = palette[source_row[source_columns[x]]];
+		}
+		status = write_y4m_frame(&writer, pixels, width);
+	}
 
-		/* There are SIN_INDICES increments between 0 and 2PI,
-		 * therefore sin(x) = sin(x % SIN_INDICES)
-		 */
-		t1 %= SIN_INDICES;
-		t2 %= SIN_INDICES;
+	if (0 != stop_y4m_writer(&writer))
+		status = -1;
+	double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	// stdout may well be the video
+	fprintf(stderr, "%u frames in %.2f s, %.1f frames/s\n", frame, seconds, frame / seconds);
 
-		row_base_palette_index = SIN(t1) + SIN(t2);
-		for(row_offset = 0; row_offset < plasma_surface->w; ++row_offset) {
-			t3 %= SIN_INDICES;
-			t4 %= SIN_INDICES;
+	SDL_FreeSurface(palette_surface);
+	free(pixels);
+	free(source_columns);
+	return status;
+};
 
-			pixel_palette_index = row_base_palette_index + SIN(t3) + SIN(t4);
+int main(int argc, char **argv) {
+	prepare_sin();
 
-			((Uint8*) plasma_surface->pixels)[plasma_surface->w * surface_row + row_offset] = (Uint8) (PLASMA_PEAK + pixel_palette_index);
-			t3 += 1;
-			t4 += 2;
+	/*
+	 * --uncapped renders as fast as it can instead of waiting for vsync
+	 * --y4m FILE renders FRAMES frames of WIDTHxHEIGHT video into FILE (- is
+	 * stdout) without opening a window
+	 */
+	bool uncapped = false;
+	const char *y4m_path = NULL;
+	unsigned int frame_count = RECORD_FRAMES;
+	unsigned int record_width = RECORD_WIDTH, record_height = RECORD_HEIGHT;
+	int arg_idx;
+	for (arg_idx = 1; arg_idx < argc; ++arg_idx) {
+		bool valid = true;
+		if (0 == strcmp(argv[arg_idx], "--uncapped"))
+			uncapped = true;
+		else if (arg_idx + 1 >= argc)
+			valid = false;
+		else if (0 == strcmp(argv[arg_idx], "--y4m"))
+			y4m_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "-n"))
+			valid = 1 == sscanf(argv[++arg_idx], "%u", &frame_count);
+		else if (0 == strcmp(argv[arg_idx], "-s"))
+			valid = 2 == sscanf(argv[++arg_idx], "%ux%u", &record_width, &record_height);
+		else
+			valid = false;
+
+		if (!valid) {
+			fprintf(stderr, "usage: %s [--uncapped]\n       %s --y4m FILE|- [-n FRAMES] [-s WIDTHxHEIGHT]\n", argv[0], argv[0]);
+			return EXIT_FAILURE;
 		}
-		t1 += 2;
-		t2 += 1;
 	}
-};
 
-int main() {
-	prepare_sin();
+	if (y4m_path)
+		return (0 == record_plasma(y4m_path, frame_count, record_width, record_height)) ? EXIT_SUCCESS : EXIT_FAILURE;
 
 	/*
 	 * A window is just a window, with height, width, a title and a
@@ -189,9 +192,12 @@ int main() {
 	renderer = SDL_CreateRenderer(
 		window,
 		-1,
-		SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
+		uncapped ? SDL_RENDERER_ACCELERATED : SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
 	);
 
+	SDL_DisplayMode display_mode = { .refresh_rate = 0 };
+	SDL_GetWindowDisplayMode(window, &display_mode);
+
 	// I want to use a Surface to directly access pixels
 	// I'll then create a texture FROM that surface that the window renderer
 	// will copy FROM
@@ -212,21 +218,39 @@ int main() {
 	SDL_FreeSurface(my_surface);
 
 
-	// These are incremented for every frame by their respective sp*
-	// increments
+	// These are incremented for every simulation tick by their respective
+	// sp* increments
 	int p1, p2, p3, p4;
 	p1=p2=p3=p4=0;
 
-	// These are increments
-	static unsigned int sp1 = 4, sp2 = 2, sp3 = 4, sp4 = 2;
+	struct frame_clock clock;
+	frame_clock_init(&clock, PLASMA_TICK_RATE, display_mode.refresh_rate);
 
 	bool running = true;
 	unsigned int time = 0;
 	while (running) {
 
+		unsigned int ticks = frame_clock_advance(&clock);
+		while (ticks--) {
+			++time;
+			p1 += sp1;
+			p2 -= sp2;
+			p3 += sp3;
+			p4 -= sp4;
+		}
+
+		// Render part of the way towards the next tick
+		float alpha = frame_clock_alpha(&clock);
+
 		SDL_LockSurface(palette_surface);
-		prepare_palette(palette_surface->format->palette, ++time);
-		draw_plasma_to_surface(palette_surface, p1, p2, p3, p4);
+		prepare_palette(palette_surface->format->palette, time);
+		draw_plasma_to_surface(
+			palette_surface,
+			p1 + (int) (alpha * sp1),
+			p2 - (int) (alpha * sp2),
+			p3 + (int) (alpha * sp3),
+			p4 - (int) (alpha * sp4)
+		);
 		SDL_UnlockSurface(palette_surface);
 
 		SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
@@ -244,11 +268,6 @@ int main() {
 		// to the window it's tied to
 		SDL_RenderPresent(renderer);
 
-		p1 += sp1;
-		p2 -= sp2;
-		p3 += sp3;
-		p4 -= sp4;
-
 		SDL_Event event;
 		while (0 != SDL_PollEvent(&event)) {
 			if (SDL_QUIT == event.type)
@@ -270,6 +289,8 @@ int main() {
 		}
 	}
 
+	frame_clock_report(&clock, stdout);
+
 	SDL_FreeSurface(palette_surface);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
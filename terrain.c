@@ -1,343 +1,469 @@
 #include "terrain.h"
 
-inline SDL_Color hex_to_colour(unsigned int hex) {
-	return (SDL_Color) {
-			.r=(hex & 0xFF0000) >> 16,
-			.g=(hex & 0x00FF00) >> 8,
-			.b=(hex & 0x0000FF),
-			.a=0x00,
-	};
-};
+int render_pipeline_worker(void *data) {
+	struct render_pipeline *pipeline = (struct render_pipeline*) data;
+
+	SDL_LockMutex(pipeline->lock);
+	while (true) {
+		struct terrain_frame *frame = &pipeline->frames[pipeline->rendered % PIPELINE_DEPTH];
+		while ((FRAME_QUEUED != frame->state || pipeline->paused) && !pipeline->stopping)
+			SDL_CondWait(pipeline->changed, pipeline->lock);
+		if (pipeline->stopping)
+			break;
 
-void random_unit_vector(struct vector *dest) {
-	float angle = ((float) rand() * 2 * M_PI) / (RAND_MAX);
-	dest->x = cos(angle);
-	dest->y = sin(angle);
+		// The frame is ours until it's marked as ready
+		pipeline->rendering = true;
+		SDL_UnlockMutex(pipeline->lock);
+		Uint64 start = SDL_GetPerformanceCounter();
+		pipeline->renderer.camera_z = frame->camera.altitude;
+		pipeline->renderer.heading = frame->camera.heading;
+		render_terrain(&pipeline->renderer, &frame->terrain, pipeline->map, &frame->camera.position);
+		render_top_down_map(&frame->top_down_map, pipeline->map, &frame->camera.position);
+		frame->render_time = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+		SDL_LockMutex(pipeline->lock);
+
+		frame->state = FRAME_READY;
+		pipeline->rendering = false;
+		pipeline->rendered++;
+		SDL_CondBroadcast(pipeline->changed);
+	}
+	SDL_UnlockMutex(pipeline->lock);
+	return 0;
 };
 
-inline float increasing_interpolant(float x) {
-	// x=0 -> 0
-	// x=1 -> 1
-	// x=0.5 -> 0.5
-	return 3 * pow(x, 2) - 2 * pow(x, 3);
-};
+void start_render_pipeline(struct render_pipeline *pipeline, const struct elevation_map *map, unsigned int width, unsigned int height, unsigned int depth) {
+	pipeline->map = map;
+
+	// The pipeline's own worker is one of the threads rendering the terrain
+	int cpu_count = SDL_GetCPUCount();
+	// The camera's altitude and heading come with every frame
+	init_terrain_renderer(&pipeline->renderer, (cpu_count > 1) ? cpu_count - 1 : 0, width, depth);
+	pipeline->submitted = pipeline->rendered = pipeline->presented = 0;
+	pipeline->stopping = pipeline->paused = pipeline->rendering = false;
+
+	unsigned int frame_idx;
+	for (frame_idx = 0; frame_idx < PIPELINE_DEPTH; ++frame_idx) {
+		struct terrain_frame *frame = &pipeline->frames[frame_idx];
+		frame->state = FRAME_FREE;
+		frame->terrain = (struct pixel_buffer) {
+			.width = width,
+			.height = height,
+			.pixels = (Uint32*) calloc((size_t) width * height, sizeof(Uint32)),
+		};
+		frame->top_down_map = (struct pixel_buffer) {
+			.width = TOP_DOWN_MAP_SIDE,
+			.height = TOP_DOWN_MAP_SIDE,
+			.pixels = (Uint32*) calloc(TOP_DOWN_MAP_SIDE * TOP_DOWN_MAP_SIDE, sizeof(Uint32)),
+		};
+	}
 
-float dot_product(const struct vector *lhs, const struct vector *rhs) {
-	/*
-	 * For each vector, we have -1 <= x,y <= 1 (within a cell of the grid)
-	 * the product is 
-	 * -2 <= dot_product <= 2
-	 */
-	return (lhs->x * rhs->x) + (lhs->y * rhs->y);
+	pipeline->lock = SDL_CreateMutex();
+	pipeline->changed = SDL_CreateCond();
+	pipeline->worker = SDL_CreateThread(render_pipeline_worker, "render_pipeline", pipeline);
 };
 
-float get_map_elevation(const struct elevation_map *map, unsigned int map_x, unsigned int map_y) {
-	if (map_x < 0 || map_y < 0 || map_x > map->width || map_y > map->height)
-		return 0.;
-
-	const unsigned int nodes_per_side = 1 + (map->width / map->step);
-	unsigned int segment_x, segment_y;
-
-	segment_y = map_y / map->step;
-	segment_x = map_x / map->step;
-
-	unsigned int vector_idx_above_left, vector_idx_above_right, vector_idx_below_left, vector_idx_below_right;
-	vector_idx_above_left = segment_y * nodes_per_side + segment_x;
-	vector_idx_above_right = segment_y * nodes_per_side + segment_x + 1;
-	vector_idx_below_left = (segment_y + 1) * nodes_per_side + segment_x;
-	vector_idx_below_right = (segment_y + 1) * nodes_per_side + segment_x + 1;
-
-	unsigned int node_above_y = segment_y * map->step;
-	unsigned int node_below_y = node_above_y + map->step;
-	unsigned int node_left_x = segment_x * map->step;
-	unsigned int node_right_x = node_left_x + map->step;
+void stop_render_pipeline(struct render_pipeline *pipeline) {
+	SDL_LockMutex(pipeline->lock);
+	pipeline->stopping = true;
+	SDL_CondBroadcast(pipeline->changed);
+	SDL_UnlockMutex(pipeline->lock);
+	SDL_WaitThread(pipeline->worker, NULL);
+	free_terrain_renderer(&pipeline->renderer);
+
+	SDL_DestroyCond(pipeline->changed);
+	SDL_DestroyMutex(pipeline->lock);
+
+	unsigned int frame_idx;
+	for (frame_idx = 0; frame_idx < PIPELINE_DEPTH; ++frame_idx) {
+		free(pipeline->frames[frame_idx].terrain.pixels);
+		free(pipeline->frames[frame_idx].top_down_map.pixels);
+	}
+};
 
-	struct vector from_below_left = {
-		.x = ((float) map_x - node_left_x) / map->step,
-		.y = ((float) map_y - node_below_y) / map->step,
-	};
+void pause_render_pipeline(struct render_pipeline *pipeline) {
+	// Returns once the worker's done with whatever frame it was rendering
+	SDL_LockMutex(pipeline->lock);
+	pipeline->paused = true;
+	while (pipeline->rendering)
+		SDL_CondWait(pipeline->changed, pipeline->lock);
+	SDL_UnlockMutex(pipeline->lock);
+};
 
-	struct vector from_below_right = {
-		.x = ((float) map_x - node_right_x) / map->step,
-		.y = from_below_left.y,
-	};
+void resume_render_pipeline(struct render_pipeline *pipeline) {
+	SDL_LockMutex(pipeline->lock);
+	pipeline->paused = false;
+	SDL_CondBroadcast(pipeline->changed);
+	SDL_UnlockMutex(pipeline->lock);
+};
 
-	struct vector from_above_left = {
-		.x = from_below_left.x,
-		.y = ((float) map_y - node_above_y) / map->step,
-	};
+void queue_frame(struct render_pipeline *pipeline, const struct camera_state *camera) {
+	SDL_LockMutex(pipeline->lock);
+	struct terrain_frame *frame = &pipeline->frames[pipeline->submitted % PIPELINE_DEPTH];
+	while (FRAME_FREE != frame->state)
+		SDL_CondWait(pipeline->changed, pipeline->lock);
+
+	frame->camera = *camera;
+	frame->state = FRAME_QUEUED;
+	pipeline->submitted++;
+	SDL_CondBroadcast(pipeline->changed);
+	SDL_UnlockMutex(pipeline->lock);
+};
 
-	struct vector from_above_right = {
-		.x = from_below_right.x,
-		.y = from_above_left.y,
-	};
+struct terrain_frame *acquire_frame(struct render_pipeline *pipeline) {
+	/*
+	 * Frames are presented in the order they were queued. We keep one frame
+	 * in flight so that the worker renders frame N+1 while frame N is being
+	 * presented: there's nothing to present until the second frame has been
+	 * queued.
+	 */
+	if (pipeline->submitted - pipeline->presented < 2)
+		return NULL;
+	return wait_for_frame(pipeline);
+};
 
-	float s = dot_product(&map->node_vectors[vector_idx_below_left], &from_below_left);
-	float t = dot_product(&map->node_vectors[vector_idx_below_right], &from_below_right);
-	float u = dot_product(&map->node_vectors[vector_idx_above_left], &from_above_left);
-	float v = dot_product(&map->node_vectors[vector_idx_above_right], &from_above_right);
+struct terrain_frame *wait_for_frame(struct render_pipeline *pipeline) {
+	// The oldest frame that's been queued but not presented, once it's ready
+	SDL_LockMutex(pipeline->lock);
+	struct terrain_frame *frame = &pipeline->frames[pipeline->presented % PIPELINE_DEPTH];
+	while (FRAME_READY != frame->state)
+		SDL_CondWait(pipeline->changed, pipeline->lock);
+	SDL_UnlockMutex(pipeline->lock);
+	return frame;
+};
 
-	float bottom_pair_avg = (1 - increasing_interpolant(from_above_left.x)) * s + increasing_interpolant(from_above_left.x) * t;
-	float top_pair_avg = (1 - increasing_interpolant(from_above_left.x)) * u + increasing_interpolant(from_above_left.x) * v;
-	float sum = (1 - increasing_interpolant(from_above_left.y)) * top_pair_avg + increasing_interpolant(from_above_left.y) * bottom_pair_avg;
+void release_frame(struct render_pipeline *pipeline, struct terrain_frame *frame) {
+	SDL_LockMutex(pipeline->lock);
+	frame->state = FRAME_FREE;
+	pipeline->presented++;
+	SDL_CondBroadcast(pipeline->changed);
+	SDL_UnlockMutex(pipeline->lock);
+};
 
+void reload_terrain_config(struct render_pipeline *pipeline, struct elevation_map *map, struct terrain_config *config, const char *path, unsigned int seed) {
 	/*
-	 * This is a bit arbitrary, but we need to normalise the elevation so it
-	 * ends up 0 <= x <= 1
+	 * Only what depends on the settings that changed is rebuilt: the ramp's
+	 * LUT, the lattice and/or the elevation cache, the renderer for a new
+	 * view depth. The camera height goes out with the next frame. A config
+	 * that doesn't load leaves everything as it was. A new lattice comes
+	 * from the session's seed, so that the terrain doesn't depend on how
+	 * many times the config was edited.
 	 */
-	sum = (sum + fabs(TERRAIN_NORMALISED_MIN)) / (TERRAIN_NORMALISED_MAX - TERRAIN_NORMALISED_MIN);
-	if (sum < 0)
-		sum=0;
-	if (sum > 1)
-		sum=1;
+	struct terrain_config loaded;
+	if (0 != load_terrain_config(&loaded, path))
+		return;
+	if (0 != map->width % loaded.step || 0 != map->height % loaded.step) {
+		fprintf(stderr, "%s: the map size must be a multiple of the step (%u)\n", path, loaded.step);
+		return;
+	}
 
-	return sum;
+	unsigned int changes = terrain_config_changes(config, &loaded);
+	if (!changes)
+		return;
+
+	// The worker mustn't be rendering from any of this while it changes
+	Uint64 start = SDL_GetPerformanceCounter();
+	pause_render_pipeline(pipeline);
+
+	if (changes & CONFIG_RAMP)
+		apply_ramp_config(map->colour_ramp, &loaded);
+	if (changes & CONFIG_LATTICE)
+		srand(seed);
+	apply_map_config(map, &loaded, changes);
+	if (changes & CONFIG_VIEW) {
+		const unsigned int thread_count = pipeline->renderer.pool.thread_count;
+		free_terrain_renderer(&pipeline->renderer);
+		init_terrain_renderer(&pipeline->renderer, thread_count, WINDOW_WIDTH, loaded.view_depth);
+	}
+	*config = loaded;
+
+	resume_render_pipeline(pipeline);
+
+	printf(
+		"Reloaded %s:%s%s%s%s%s in %.1f ms\n",
+		path,
+		(changes & CONFIG_RAMP) ? " ramp" : "",
+		(changes & CONFIG_LATTICE) ? " lattice" : "",
+		(changes & (CONFIG_LATTICE | CONFIG_ELEVATIONS)) ? " elevations" : "",
+		(changes & CONFIG_VIEW) ? " view" : "",
+		(changes & CONFIG_CAMERA) ? " camera" : "",
+		1e3 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency()
+	);
 };
 
-void create_noise_vectors(struct elevation_map *map) {
-	assert(map->width == map->height);
-	assert((map->width) % map->step == 0);
+bool drive_camera(struct camera_driver *driver, struct camera_state *camera) {
+	/*
+	 * One simulation tick's worth of camera motion. Returns false once the
+	 * path or the replay is over.
+	 */
+	if (driver->path)
+		return advance_camera_path(driver->path, 1. / TERRAIN_TICK_RATE, camera);
+
+	Uint32 controls = 0;
+	if (driver->replay) {
+		if (!replay_input(driver->replay, &controls))
+			return false;
+	} else if (driver->headless)
+		controls = CONTROL_UP;
+	else {
+		// The camera moves for as long as the arrow keys are held down
+		const Uint8 *keys = SDL_GetKeyboardState(NULL);
+		controls = (keys[SDL_SCANCODE_UP] ? CONTROL_UP : 0)
+			| (keys[SDL_SCANCODE_DOWN] ? CONTROL_DOWN : 0)
+			| (keys[SDL_SCANCODE_LEFT] ? CONTROL_LEFT : 0)
+			| (keys[SDL_SCANCODE_RIGHT] ? CONTROL_RIGHT : 0);
+	}
+	if (driver->recording)
+		record_input(driver->recording, controls);
+
+	const float tick_distance = CAMERA_SPEED / TERRAIN_TICK_RATE;
+	if (controls & CONTROL_UP)
+		camera->position.y -= tick_distance;
+	if (controls & CONTROL_DOWN)
+		camera->position.y += tick_distance;
+	if (controls & CONTROL_LEFT)
+		camera->position.x -= tick_distance;
+	if (controls & CONTROL_RIGHT)
+		camera->position.x += tick_distance;
+	// The config may have changed since the last tick
+	camera->altitude = driver->config->camera_z;
+	return true;
+};
 
-	const unsigned int nodes_per_side = 1 + (map->width / map->step);
+int start_frame_timings(struct frame_timings *timings, const char *path, unsigned int seed) {
+	// "-" is stdout, unless that's where the video goes
+	*timings = (struct frame_timings) { .file = NULL };
+	timings->file = (0 == strcmp(path, "-")) ? stdout : fopen(path, "w");
+	if (!timings->file) {
+		fprintf(stderr, "Cannot open %s for writing\n", path);
+		return -1;
+	}
+	fprintf(timings->file, "# seed %u\n# frame render_ms frame_ms x y heading altitude\n", seed);
+	return 0;
+};
 
-	// Allocate vectors
-	map->node_vectors = (struct vector*) calloc(
-		nodes_per_side * nodes_per_side,
-		sizeof(struct vector)
+void record_frame_timings(struct frame_timings *timings, const struct terrain_frame *frame, double frame_time) {
+	// The camera's in there so that runs can be lined up with each other
+	fprintf(
+		timings->file,
+		"%lu %.3f %.3f %.2f %.2f %.1f %.1f\n",
+		timings->frames,
+		1e3 * frame->render_time,
+		1e3 * frame_time,
+		frame->camera.position.x,
+		frame->camera.position.y,
+		frame->camera.heading * 180 / M_PI,
+		frame->camera.altitude
 	);
-
-	// Would be nice if there were a nicer way that doesn't rely on integer
-	// counters
-	unsigned int node_x, node_y;
-	for(node_y = 0; node_y < nodes_per_side; ++node_y)
-		for(node_x = 0; node_x < nodes_per_side; ++node_x)
-			random_unit_vector(&map->node_vectors[node_y * nodes_per_side + node_x]);
+	timings->frames++;
+	timings->total_render_time += frame->render_time;
+	timings->total_frame_time += frame_time;
+	if (frame->render_time > timings->worst_render_time)
+		timings->worst_render_time = frame->render_time;
+	if (frame_time > timings->worst_frame_time)
+		timings->worst_frame_time = frame_time;
 };
 
-void push_gradient(struct colour_ramp *ramp, float gradient_max, SDL_Color hex_colour) {
-	assert(gradient_max > ramp->min);
-	assert(gradient_max < ramp->max);
-
-	struct ramp_gradient *new_gradient = malloc(sizeof(struct ramp_gradient));
-	*new_gradient = (struct ramp_gradient) {
-		.max = gradient_max,
-		.colour = hex_colour,
-		.next = NULL,
-	};
+void stop_frame_timings(struct frame_timings *timings) {
+	if (timings->frames)
+		fprintf(
+			stderr,
+			"%lu frames: render %.3f ms average, %.3f ms worst; frame %.3f ms average, %.3f ms worst\n",
+			timings->frames,
+			1e3 * timings->total_render_time / timings->frames,
+			1e3 * timings->worst_render_time,
+			1e3 * timings->total_frame_time / timings->frames,
+			1e3 * timings->worst_frame_time
+		);
+	if (stdout != timings->file)
+		fclose(timings->file);
+	else
+		fflush(stdout);
+};
 
-	struct ramp_gradient *previous, *current;
-	previous = current = ramp->gradients;
-	while (current) {
-		if (current->max > new_gradient->max)
-			break;
-		previous = current;
-		current = current->next;
-	};
-	new_gradient->next = current;
+static void finish_headless_frame(struct render_pipeline *pipeline, struct terrain_frame *frame, struct y4m_writer *writer, struct frame_timings *timings, Uint64 *previous, int *status) {
+	Uint64 now = SDL_GetPerformanceCounter();
+	if (timings)
+		record_frame_timings(timings, frame, (double) (now - *previous) / SDL_GetPerformanceFrequency());
+	*previous = now;
 
-	if (previous)
-		previous->next = new_gradient;
-	else
-		ramp->gradients = new_gradient;
+	if (writer && 0 == *status)
+		*status = write_y4m_frame(writer, frame->terrain.pixels, frame->terrain.width);
+	release_frame(pipeline, frame);
 };
 
-void elevation_to_colour(float elevation, struct colour_ramp *ramp, SDL_Color *colour) {
+int run_headless(const struct elevation_map *map, struct camera_driver *driver, const char *y4m_path, unsigned int frame_count, struct frame_timings *timings) {
 	/*
-	 * It is assumed that the list of gradients is sorted!
+	 * No window and no clock: the camera moves one simulation tick per frame
+	 * and frames are rendered as fast as they come, for frame_count frames
+	 * or until the path or replay is over. The worker renders frame N+1
+	 * while frame N is handed to the video writer, if there is one, which
+	 * converts and writes it on its own thread.
 	 */
-	SDL_Color *bottom_colour, *top_colour;
-	float min, max;
-	bottom_colour = &ramp->min_colour;
-	min = ramp->min;
-
-	struct ramp_gradient *current = ramp->gradients;
-	while (current) {
-		if (elevation <= current->max)
-			break;
-		min = current->max;
-		bottom_colour = &current->colour;
-		current = current->next;
-	};
+	struct y4m_writer writer;
+	if (y4m_path && 0 != start_y4m_writer(&writer, y4m_path, WINDOW_WIDTH, WINDOW_HEIGHT, TERRAIN_TICK_RATE))
+		return -1;
 
-	if (current) {
-		max = current->max;
-		top_colour = &current->colour;
-	} else {
-		max = ramp->max;
-		top_colour = &ramp->max_colour;
+	struct render_pipeline pipeline;
+	start_render_pipeline(&pipeline, map, WINDOW_WIDTH, WINDOW_HEIGHT, driver->config->view_depth);
+
+	struct camera_state camera = {
+		.position = { .x=map->width/2, .y=3*map->height/4 },
+		.heading = 0.,
+		.altitude = driver->config->camera_z,
 	};
+	if (driver->path)
+		start_camera_path(driver->path, &camera);
+
+	int status = 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+	Uint64 previous = start;
+	unsigned int frame_idx;
+	for (frame_idx = 0; !frame_count || frame_idx < frame_count; ++frame_idx) {
+		queue_frame(&pipeline, &camera);
+		if (!drive_camera(driver, &camera) && !frame_count)
+			frame_count = frame_idx + 1;
+
+		struct terrain_frame *frame = acquire_frame(&pipeline);
+		if (frame)
+			finish_headless_frame(&pipeline, frame, y4m_path ? &writer : NULL, timings, &previous, &status);
+	}
 
-	// Normalise the elevation relative to the elevation_gradient
-	float normalised = (elevation - min) / (max - min);
-	float interpolation_factor = increasing_interpolant(normalised);
+	// The last frame is still in flight
+	while (pipeline.presented < pipeline.submitted)
+		finish_headless_frame(&pipeline, wait_for_frame(&pipeline), y4m_path ? &writer : NULL, timings, &previous, &status);
 
-	colour->r = bottom_colour->r * (1 - interpolation_factor) + top_colour->r * interpolation_factor;
-	colour->g = bottom_colour->g * (1 - interpolation_factor) + top_colour->g * interpolation_factor;
-	colour->b = bottom_colour->b * (1 - interpolation_factor) + top_colour->b * interpolation_factor;
-};
+	stop_render_pipeline(&pipeline);
+	if (y4m_path && 0 != stop_y4m_writer(&writer))
+		status = -1;
 
-void render_terrain(SDL_Renderer *renderer, const struct elevation_map *map, const struct vector *position, const unsigned int depth) {
-	unsigned int camera_x, camera_y;
-	camera_x = (unsigned int) position->x;
-	camera_y = (unsigned int) position->y;
+	double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	// stdout may well be the video
+	fprintf(stderr, "%u frames in %.2f s, %.1f frames/s\n", frame_count, seconds, frame_count / seconds);
+	return status;
+};
 
-	SDL_Texture *target;
-	int target_w, target_h;
-	target = SDL_GetRenderTarget(renderer);
-	SDL_QueryTexture(target, NULL, NULL, &target_w, &target_h);
+static void export_usage(void) {
+	fprintf(stderr,
+		"Usage: terrain export [options] PREFIX\n"
+		"  -s WIDTHxHEIGHT  map size (default %ux%u)\n"
+		"  -p STEP          noise lattice step (default %u)\n"
+		"  -f pgm|raw       16-bit binary PGM or raw little-endian samples\n"
+		"  -t WIDTHxHEIGHT  split the map into tiles of this size\n"
+		"  -b ROWS          rows generated per band (default %u)\n"
+		"  -j THREADS       number of generator threads\n"
+		"  -r SEED          seed for the noise lattice\n",
+		TERRAIN_WIDTH, TERRAIN_HEIGHT, TERRAIN_STEP, EXPORT_BAND_ROWS
+	);
+};
 
-	//TODO Draw a better sky
-	SDL_SetRenderDrawColor(renderer, 0x77, 0xB5, 0xFE, SDL_ALPHA_OPAQUE);
-	SDL_RenderClear(renderer);
+int export_main(int argc, char **argv) {
+	struct elevation_map map = {
+		.width = TERRAIN_WIDTH,
+		.height = TERRAIN_HEIGHT,
+		.step = TERRAIN_STEP,
+		.colour_ramp = NULL,
+		.node_vectors = NULL,
+		.elevations = NULL,
+	};
 
-	// TODO Should we just use the target's width?
-	unsigned int rectangles_per_row = 100;
+	struct heightmap_export export = {
+		.map = &map,
+		.format = HEIGHTMAP_PGM,
+		.prefix = NULL,
+		.tile_width = 0,
+		.tile_height = 0,
+		.band_rows = EXPORT_BAND_ROWS,
+		.threads = SDL_GetCPUCount(),
+	};
+	unsigned int seed = (unsigned int) time(NULL);
 
-	// These are quantities expressed in 3D world units and must therefore be
-	// consistent and sensible
-	unsigned int distance_to_projection_plane = 100;
+	int arg_idx;
+	for (arg_idx = 0; arg_idx < argc; ++arg_idx) {
+		const char *arg = argv[arg_idx];
+		const char *value = (arg_idx + 1 < argc) ? argv[arg_idx + 1] : NULL;
+		bool valid = true;
 
-	// In the "Mars" demo, the camera is always a fixed offset above the terrain
-	//float camera_z = 100 * (.3 + get_map_elevation(map, camera_x, camera_y));
-	float camera_z = 120;
+		if ('-' != arg[0]) {
+			export.prefix = arg;
+			continue;
+		}
+		if (!value || '\0' == arg[1] || '\0' != arg[2]) {
+			export_usage();
+			return EXIT_FAILURE;
+		}
 
-	/*
-	 * In most 3D projection examples, the workflow involves the conversion of
-	 * a 3D vertex to a 2D pixel on the rendering surface. In these scenarios,
-	 * it is implicit that we iterate on a collection of 3D vertices coming
-	 * from some data source.
-	 * Here, however, we need to scan the map in front of the camera, derive
-	 * the elevation from the map's coordinates, *then* project that vertex.
-	 *
-	 * We'll scan a rectangle rectangles_per_row map-units wide and depth map-
-	 * units deep
-	 */
-	int rectangle_y_on_map, rectangle_idx;
-	for (rectangle_y_on_map=camera_y-depth; rectangle_y_on_map < (camera_y-1); ++rectangle_y_on_map) {
-		for (rectangle_idx=0; rectangle_idx<rectangles_per_row; ++rectangle_idx) {
-			unsigned int rectangle_x_on_map = camera_x + rectangle_idx - rectangles_per_row/2;
-
-			//TODO draw gradients instead of single-colour rectangles
-			SDL_Color rectangle_colour;
-
-			float rectangle_elevation = get_map_elevation(map, rectangle_x_on_map, rectangle_y_on_map);
-
-			elevation_to_colour(rectangle_elevation, map->colour_ramp, &rectangle_colour);
-			SDL_SetRenderDrawColor(
-				renderer,
-				rectangle_colour.r,
-				rectangle_colour.g,
-				rectangle_colour.b,
-				rectangle_colour.a
-			);
-
-			//TODO figure out how to sensibly scale elevations
-			rectangle_elevation *= 100;
-
-
-			float vox_x = (((float) rectangle_x_on_map - camera_x) * distance_to_projection_plane) / (-rectangle_y_on_map + camera_y);
-			float vox_y = ((rectangle_elevation-camera_z) * distance_to_projection_plane)/(-rectangle_y_on_map + camera_y);
-
-			/*
-			 * This data structure can only map to *integer* pixel coordinates 
-			 */
-			SDL_Rect voxel_rect = {
-				.x = (int) (vox_x) + (target_w/2),
-				.y = (int) -(vox_y) + (target_h/2),
-				.w = (int) ((float) target_w/rectangles_per_row) * distance_to_projection_plane / (camera_y-rectangle_y_on_map),
-				.h = (target_h/2) + (int) (vox_y),
-			};
-			/*
-			printf("Xmap: %d, Ymap: %d Elevation: %f\nCamera coords on map: %d/%d\nUnscaled 2D floating point coords: %f/%f\n",
-					rectangle_x_on_map, rectangle_y_on_map, rectangle_elevation,
-					camera_x, camera_y,
-					vox_x, vox_y
-			);
-			*/
-
-			SDL_RenderFillRect(renderer, &voxel_rect);
+		switch (arg[1]) {
+			case 's':
+				valid = 2 == sscanf(value, "%ux%u", &map.width, &map.height);
+				break;
+			case 'p':
+				valid = 1 == sscanf(value, "%u", &map.step);
+				break;
+			case 'f':
+				if (0 == strcmp(value, "pgm"))
+					export.format = HEIGHTMAP_PGM;
+				else if (0 == strcmp(value, "raw"))
+					export.format = HEIGHTMAP_RAW;
+				else
+					valid = false;
+				break;
+			case 't':
+				valid = 2 == sscanf(value, "%ux%u", &export.tile_width, &export.tile_height);
+				break;
+			case 'b':
+				valid = 1 == sscanf(value, "%u", &export.band_rows);
+				break;
+			case 'j':
+				valid = 1 == sscanf(value, "%u", &export.threads);
+				break;
+			case 'r':
+				valid = 1 == sscanf(value, "%u", &seed);
+				break;
+			default:
+				valid = false;
 		};
-	};
-};
+		if (!valid) {
+			export_usage();
+			return EXIT_FAILURE;
+		}
+		++arg_idx;
+	}
 
-void render_top_down_map(SDL_Surface *map_surface, struct elevation_map *map, const struct vector *camera) {
-	unsigned int map_left_x, map_top_y;
+	if (!export.prefix || 0 == map.step || 0 == map.width || 0 == map.height) {
+		export_usage();
+		return EXIT_FAILURE;
+	}
+	if (0 != map.width % map.step || 0 != map.height % map.step) {
+		fprintf(stderr, "The map size must be a multiple of the step (%u)\n", map.step);
+		return EXIT_FAILURE;
+	}
+	if (0 == export.tile_width || export.tile_width > map.width)
+		export.tile_width = map.width;
+	if (0 == export.tile_height || export.tile_height > map.height)
+		export.tile_height = map.height;
+	if (0 == export.band_rows)
+		export.band_rows = EXPORT_BAND_ROWS;
+	if (0 == export.threads)
+		export.threads = 1;
+
+	srand(seed);
+	create_noise_vectors(&map);
 
-	if (camera->x < map_surface->w/2)
-		map_left_x = 0;
-	else
-		map_left_x = camera->x - (map_surface->w/2);
+	int status = export_heightmap(&export);
+	free_elevation_map(&map);
 
-	if (camera->y < map_surface->h/2)
-		map_top_y = 0;
-	else
-		map_top_y = camera->y - (map_surface->h/2);
-
-	unsigned int surf_x, surf_y;
-	SDL_Color pix_colour;
-	for (surf_y = 0; surf_y < map_surface->h; ++surf_y) {
-		for (surf_x = 0; surf_x < map_surface->w; ++surf_x) {
-
-			elevation_to_colour(
-				get_map_elevation(
-					map,
-					map_left_x + surf_x,
-					map_top_y + surf_y
-				),
-				map->colour_ramp,
-				&pix_colour
-			);
-
-			((Uint32*) map_surface->pixels)[surf_y * map_surface->w + surf_x] = SDL_MapRGB(
-				map_surface->format,
-				pix_colour.r,
-				pix_colour.g,
-				pix_colour.b
-			);
-		}
-	}
+	return (0 == status) ? EXIT_SUCCESS : EXIT_FAILURE;
 };
 
-int main(int argc, char **argv) {
+int run_window(struct elevation_map *map, struct terrain_config *config, const char *config_path, unsigned int seed, struct camera_driver *driver, bool uncapped, struct frame_timings *timings) {
 	SDL_Window *window;
 
 	SDL_Renderer *renderer;
 
-	SDL_Surface *height_map_surface;
-
 	SDL_Texture *map_texture;
 	SDL_Texture *terrain_texture;
 
-	srand((unsigned int) time(NULL));
-
-
-	struct elevation_map map;
-	map.width = TERRAIN_WIDTH;
-	map.height = TERRAIN_HEIGHT;
-	map.step = TERRAIN_STEP;
-
-	map.colour_ramp = &(struct colour_ramp) {
-		.min=0.,
-		.max=1.,
-		.min_colour=hex_to_colour(0x000080),
-		.max_colour=hex_to_colour(0xFFFFFF),
-		.gradients=NULL,
-	};
-
-	push_gradient(map.colour_ramp, 0.3, hex_to_colour(0x228B22));
-	push_gradient(map.colour_ramp, 0.85, hex_to_colour(0xC19A6B));
-	push_gradient(map.colour_ramp, 0.95, hex_to_colour(0xC8C8C8));
-
-	create_noise_vectors(&map);
-
-	height_map_surface = SDL_CreateRGBSurface(
-		0,
-		TOP_DOWN_MAP_SIDE,
-		TOP_DOWN_MAP_SIDE,
-		32,
-		0, 0, 0, 0
-	);
-
+	struct render_pipeline pipeline;
 
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -354,107 +480,302 @@ int main(int argc, char **argv) {
 	renderer = SDL_CreateRenderer(
 		window,
 		-1,
-		SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
+		uncapped ? SDL_RENDERER_ACCELERATED : SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_ACCELERATED
 	);
 
-	struct vector camera_position = {
-		.x=map.width/2,
-		.y=3*map.height/4,
+	SDL_DisplayMode display_mode = { .refresh_rate = 0 };
+	SDL_GetWindowDisplayMode(window, &display_mode);
+
+	struct camera_state camera = {
+		.position = { .x=map->width/2, .y=3*map->height/4 },
+		.heading = 0.,
+		.altitude = config->camera_z,
 	};
+	if (driver->path)
+		start_camera_path(driver->path, &camera);
+	// Where the camera was on the previous simulation tick
+	struct camera_state previous_camera = camera;
 
+	/*
+	 * Both the terrain and the top-down map are rendered by the pipeline's
+	 * worker thread into plain pixel buffers, which we upload to these
+	 * textures before presenting them.
+	 */
 	terrain_texture = SDL_CreateTexture(
 		renderer,
-		height_map_surface->format->format,
-		SDL_TEXTUREACCESS_TARGET,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
 		WINDOW_WIDTH,
 		WINDOW_HEIGHT
 	);
+	map_texture = SDL_CreateTexture(
+		renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		TOP_DOWN_MAP_SIDE,
+		TOP_DOWN_MAP_SIDE
+	);
+
+	start_render_pipeline(&pipeline, map, WINDOW_WIDTH, WINDOW_HEIGHT, config->view_depth);
+
+	struct file_watch config_watch;
+	bool watching = config_path && start_file_watch(&config_watch, config_path);
+
+	struct frame_clock clock;
+	frame_clock_init(&clock, TERRAIN_TICK_RATE, display_mode.refresh_rate);
+	Uint64 previous_present = SDL_GetPerformanceCounter();
 
 	bool running = true;
 	while (running) {
 
-		// At this stage, the rough idea is to have a surface(texture???)
-		// prepared of the same size as the surface/texture that will be used
-		// to render the elevation map from back to front. The source
-		// surface/texture would have NO transparent pixels but instead every
-		// pixel should be painted with the elevation map-> color map, so it'd
-		// look like horizontal stripes.
-		// We'd then copy vertical rectangles from that source surface to the
-		// destination surface starting from the bottom and going as far up as
-		// the section of the elevation map we're plotting
+		SDL_Event event;
+		while (0 != SDL_PollEvent(&event)) {
+			if (SDL_QUIT == event.type)
+				running = false;
+			if (SDL_KEYDOWN == event.type && SDLK_q == event.key.keysym.sym)
+				running = false;
+		}
 
-		SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
-		SDL_RenderClear(renderer);
+		if (watching && file_changed(&config_watch))
+			reload_terrain_config(&pipeline, map, config, config_path, seed);
 
-		SDL_SetRenderTarget(renderer, terrain_texture);
-		render_terrain(renderer, &map, &camera_position, 200);
-		SDL_SetRenderTarget(renderer, NULL);
+		// The end of a path or a replay is the end of the run
+		unsigned int ticks = frame_clock_advance(&clock);
+		while (ticks--) {
+			previous_camera = camera;
+			if (!drive_camera(driver, &camera))
+				running = false;
+		}
 
-		// Render the 2D top-down map based on current camera position
-		render_top_down_map(height_map_surface, &map, &camera_position);
+		// Render part of the way towards the next tick
+		struct camera_state render_camera;
+		interpolate_camera(&previous_camera, &camera, frame_clock_alpha(&clock), &render_camera);
 
-		/* Copy the 2D top-down map surface to the top-left corner
+		/*
+		 * While the worker renders this frame, we present the previous one.
 		 */
-		map_texture = SDL_CreateTextureFromSurface(
-			renderer,
-			height_map_surface
+		queue_frame(&pipeline, &render_camera);
+
+		struct terrain_frame *frame = acquire_frame(&pipeline);
+		if (!frame)
+			continue;
+
+		SDL_UpdateTexture(
+			terrain_texture,
+			NULL,
+			frame->terrain.pixels,
+			frame->terrain.width * sizeof(Uint32)
+		);
+		SDL_UpdateTexture(
+			map_texture,
+			NULL,
+			frame->top_down_map.pixels,
+			frame->top_down_map.width * sizeof(Uint32)
 		);
-		SDL_Rect camera_rect = {
-			.x=camera_position.x-1,
-			.y=camera_position.y-1,
-			.w=2,
-			.h=2,
-		};
-		SDL_SetRenderTarget(renderer, map_texture);
-		SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, SDL_ALPHA_OPAQUE);
-		SDL_RenderFillRect(renderer, &camera_rect);
-		SDL_SetRenderTarget(renderer, NULL);
 
+		// Frame times go from one present to the next
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (timings)
+			record_frame_timings(timings, frame, (double) (now - previous_present) / SDL_GetPerformanceFrequency());
+		previous_present = now;
+		release_frame(&pipeline, frame);
 
+		SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
+		SDL_RenderClear(renderer);
+
+		/* Copy the 2D top-down map to the top-left corner
+		 */
 		SDL_RenderCopy(renderer, terrain_texture, NULL, NULL);
 		SDL_Rect map_rect = {
 			.x=0,
 			.y=0,
-			.w=height_map_surface->w,
-			.h=height_map_surface->h,
+			.w=TOP_DOWN_MAP_SIDE,
+			.h=TOP_DOWN_MAP_SIDE,
 		};
 		SDL_RenderCopy(renderer, map_texture, NULL, &map_rect);
 		SDL_RenderPresent(renderer);
-
-		SDL_Event event;
-		while (0 != SDL_PollEvent(&event)) {
-			if (SDL_QUIT == event.type)
-				running = false;
-			if (SDL_KEYDOWN == event.type) {
-				switch (event.key.keysym.sym) {
-					case SDLK_q:
-						running = false;
-						break;
-					case SDLK_UP:
-						camera_position.y-=1;
-						break;
-					case SDLK_DOWN:
-						camera_position.y+=1;
-						break;
-					case SDLK_LEFT:
-						camera_position.x-=1;
-						break;
-					case SDLK_RIGHT:
-						camera_position.x+=1;
-						break;
-				};
-			}
-		}
 	}
 
-	SDL_FreeSurface(height_map_surface);
-	SDL_DestroyRenderer(renderer);
+	frame_clock_report(&clock, stdout);
+
+	if (watching)
+		stop_file_watch(&config_watch);
+	stop_render_pipeline(&pipeline);
+
 	SDL_DestroyTexture(map_texture);
 	SDL_DestroyTexture(terrain_texture);
+	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
-	free(map.node_vectors);
-	//free(map.colour_ramp);
-
 	SDL_Quit();
-	return EXIT_SUCCESS;
+	return 0;
+};
+
+static void usage(const char *program) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"       %s export ...\n"
+		"  --uncapped        render as fast as possible instead of waiting for vsync\n"
+		"  -c CONFIG         read the terrain's settings from CONFIG, and again whenever it changes\n"
+		"  -r SEED           seed for the noise lattice\n"
+		"  --path FILE       fly the camera along the waypoints in FILE, see camera_path.h\n"
+		"  --record FILE     record the arrow keys, and the seed, into FILE\n"
+		"  --replay FILE     replay controls and the seed recorded with --record\n"
+		"  --timings FILE|-  write every frame's timings to FILE\n"
+		"  --headless        no window, render frames one simulation tick apart as fast as possible\n"
+		"  --y4m FILE|-      headless, and write the frames to FILE as a Y4M stream\n"
+		"  -n FRAMES         stop after FRAMES frames when headless (default: at the end of the\n"
+		"                    path or replay, or after %u frames)\n",
+		program, program, RECORD_FRAMES
+	);
+};
+
+int main(int argc, char **argv) {
+	// Non-interactive heightmap export doesn't need a window
+	if (argc > 1 && 0 == strcmp(argv[1], "export"))
+		return export_main(argc - 2, argv + 2);
+
+	bool uncapped = false, headless = false;
+	const char *config_path = NULL;
+	const char *waypoints_path = NULL;
+	const char *record_path = NULL;
+	const char *replay_path = NULL;
+	const char *timings_path = NULL;
+	const char *y4m_path = NULL;
+	unsigned int frame_count = 0;
+	unsigned int seed = (unsigned int) time(NULL);
+	int arg_idx;
+	for (arg_idx = 1; arg_idx < argc; ++arg_idx) {
+		bool valid = true;
+		if (0 == strcmp(argv[arg_idx], "--uncapped"))
+			uncapped = true;
+		else if (0 == strcmp(argv[arg_idx], "--headless"))
+			headless = true;
+		else if (arg_idx + 1 >= argc)
+			valid = false;
+		else if (0 == strcmp(argv[arg_idx], "-c"))
+			config_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "-r"))
+			valid = 1 == sscanf(argv[++arg_idx], "%u", &seed);
+		else if (0 == strcmp(argv[arg_idx], "--path"))
+			waypoints_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "--record"))
+			record_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "--replay"))
+			replay_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "--timings"))
+			timings_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "--y4m"))
+			y4m_path = argv[++arg_idx];
+		else if (0 == strcmp(argv[arg_idx], "-n"))
+			valid = 1 == sscanf(argv[++arg_idx], "%u", &frame_count) && frame_count > 0;
+		else
+			valid = false;
+
+		if (!valid) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Only one thing can drive the camera
+	if ((waypoints_path != NULL) + (record_path != NULL) + (replay_path != NULL) > 1) {
+		fprintf(stderr, "--path, --record and --replay don't go together\n");
+		return EXIT_FAILURE;
+	}
+	headless |= (NULL != y4m_path);
+	if (headless && record_path) {
+		fprintf(stderr, "There are no keys to record without a window\n");
+		return EXIT_FAILURE;
+	}
+	if (!headless && frame_count) {
+		fprintf(stderr, "-n only goes with --headless or --y4m, the window runs until it's closed\n");
+		return EXIT_FAILURE;
+	}
+	if (timings_path && y4m_path && 0 == strcmp(timings_path, "-") && 0 == strcmp(y4m_path, "-")) {
+		fprintf(stderr, "The timings and the video can't both go to stdout\n");
+		return EXIT_FAILURE;
+	}
+	if (!frame_count && !waypoints_path && !replay_path)
+		frame_count = RECORD_FRAMES;
+
+	struct terrain_config config;
+	default_terrain_config(&config);
+	if (config_path && 0 != load_terrain_config(&config, config_path))
+		return EXIT_FAILURE;
+	if (0 != TERRAIN_WIDTH % config.step || 0 != TERRAIN_HEIGHT % config.step) {
+		fprintf(stderr, "The map size must be a multiple of the step (%u)\n", config.step);
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * A replay goes over the same terrain as the recording did. The same goes
+	 * for the config, which isn't recorded.
+	 */
+	struct camera_path path;
+	struct input_replay replay;
+	struct input_recording recording;
+	struct camera_driver driver = {
+		.config = &config,
+		.path = NULL,
+		.replay = NULL,
+		.recording = NULL,
+		.headless = headless,
+	};
+	if (waypoints_path) {
+		if (0 != load_camera_path(&path, waypoints_path))
+			return EXIT_FAILURE;
+		driver.path = &path;
+	}
+	if (replay_path) {
+		if (0 != load_input_replay(&replay, replay_path))
+			return EXIT_FAILURE;
+		driver.replay = &replay;
+		seed = replay.seed;
+	}
+	if (record_path) {
+		if (0 != start_input_recording(&recording, record_path, seed))
+			return EXIT_FAILURE;
+		driver.recording = &recording;
+	}
+
+	struct frame_timings timings;
+	if (timings_path && 0 != start_frame_timings(&timings, timings_path, seed))
+		return EXIT_FAILURE;
+
+	srand(seed);
+
+	struct elevation_map map = {
+		.width = TERRAIN_WIDTH,
+		.height = TERRAIN_HEIGHT,
+		.step = config.step,
+		.normalised_min = config.normalised_min,
+		.normalised_max = config.normalised_max,
+		.colour_ramp = &(struct colour_ramp) {
+			.min=0.,
+			.max=1.,
+			.gradients=NULL,
+		},
+		.node_vectors = NULL,
+		.elevations = NULL,
+	};
+	apply_ramp_config(map.colour_ramp, &config);
+
+	create_noise_vectors(&map);
+	cache_elevations(&map);
+
+	int status = headless
+		? run_headless(&map, &driver, y4m_path, frame_count, timings_path ? &timings : NULL)
+		: run_window(&map, &config, config_path, seed, &driver, uncapped, timings_path ? &timings : NULL);
+
+	if (timings_path)
+		stop_frame_timings(&timings);
+	if (driver.recording && 0 != stop_input_recording(driver.recording)) {
+		fprintf(stderr, "Failed to write %s\n", record_path);
+		status = -1;
+	}
+	if (driver.replay)
+		free_input_replay(driver.replay);
+	free_elevation_map(&map);
+	free_colour_ramp(map.colour_ramp);
+	return (0 == status) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -3,16 +3,25 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <time.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "SDL.h"
 
-#define M_PI			3.14159265358979323846
+#include "camera_path.h"
+#include "colour_ramp.h"
+#include "file_watch.h"
+#include "frame_clock.h"
+#include "heightmap.h"
+#include "input_replay.h"
+#include "noise.h"
+#include "terrain_config.h"
+#include "terrain_render.h"
+#include "y4m.h"
+
+// The step, and more, come from the config, see terrain_config.h
 #define TERRAIN_WIDTH	2000
 #define TERRAIN_HEIGHT	2000
-#define TERRAIN_STEP	80
-
-#define TERRAIN_NORMALISED_MIN	-0.5
-#define TERRAIN_NORMALISED_MAX	0.65
 
 #define TOP_DOWN_MAP_SIDE	200
 
@@ -21,53 +30,115 @@
 
 #define HIGHEST_PEAK_TO_HEIGHT	0.8
 
-struct vector {
-	// TODO Use ints. Or maybe not. But figure out a way to make this more
-	// efficient if need be. Maybe. Perhaps.
-	float x;
-	float y;
+// Simulation ticks per second and camera speed in map units per second
+#define TERRAIN_TICK_RATE	60
+#define CAMERA_SPEED		30.
+
+// Headless runs without a path or a replay are this many frames long
+#define RECORD_FRAMES		(60 * TERRAIN_TICK_RATE)
+
+// What the arrow keys do, as recorded by --record
+enum camera_control {
+	CONTROL_UP = 1 << 0,
+	CONTROL_DOWN = 1 << 1,
+	CONTROL_LEFT = 1 << 2,
+	CONTROL_RIGHT = 1 << 3,
+};
+
+/*
+ * Where the camera's next move comes from: a scripted path, a replay of
+ * recorded controls or the keyboard, in that order. Without a keyboard, the
+ * camera flies north.
+ */
+struct camera_driver {
+	const struct terrain_config *config;
+	struct camera_path *path;
+	struct input_replay *replay;
+	struct input_recording *recording;
+	bool headless;
+};
+
+// Per-frame timings, written out as they come and summed up at the end
+struct frame_timings {
+	FILE *file;
+	unsigned long frames;
+	double total_render_time;
+	double worst_render_time;
+	double total_frame_time;
+	double worst_frame_time;
 };
 
-struct colour_ramp {
-	float min;
-	float max;
-	SDL_Color min_colour;
-	SDL_Color max_colour;
-	struct ramp_gradient *gradients;
+/*
+ * Frames are rendered by a worker thread while the main thread presents the
+ * previous one. A frame goes FREE -> QUEUED (main thread) -> READY (worker)
+ * -> FREE (main thread, once uploaded)
+ */
+#define PIPELINE_DEPTH	3
+
+enum frame_state {
+	FRAME_FREE,
+	FRAME_QUEUED,
+	FRAME_READY,
 };
 
-struct ramp_gradient {
-	float max;
-	SDL_Color colour;
-	struct ramp_gradient *next;
+struct terrain_frame {
+	enum frame_state state;
+	struct camera_state camera;
+	// How long the worker took to render it, in seconds
+	double render_time;
+	struct pixel_buffer terrain;
+	struct pixel_buffer top_down_map;
 };
 
-struct elevation_map {
-	unsigned int width;
-	unsigned int height;
-	unsigned int step;
-	struct colour_ramp *colour_ramp;
-	struct vector *node_vectors;
+struct render_pipeline {
+	const struct elevation_map *map;
+	struct terrain_renderer renderer;
+	struct terrain_frame frames[PIPELINE_DEPTH];
+	// Running frame counts, the frame slot is the count modulo PIPELINE_DEPTH
+	unsigned int submitted;
+	unsigned int rendered;
+	unsigned int presented;
+	bool stopping;
+	// A paused worker doesn't pick up new frames, see pause_render_pipeline
+	bool paused;
+	bool rendering;
+	SDL_mutex *lock;
+	SDL_cond *changed;
+	SDL_Thread *worker;
 };
 
 ////////////////
 
-void random_unit_vector(struct vector*);
+int render_pipeline_worker(void*);
+
+void start_render_pipeline(struct render_pipeline*, const struct elevation_map*, unsigned int, unsigned int, unsigned int);
+
+void stop_render_pipeline(struct render_pipeline*);
+
+void pause_render_pipeline(struct render_pipeline*);
+
+void resume_render_pipeline(struct render_pipeline*);
+
+void queue_frame(struct render_pipeline*, const struct camera_state*);
+
+struct terrain_frame *acquire_frame(struct render_pipeline*);
+
+struct terrain_frame *wait_for_frame(struct render_pipeline*);
 
-float increasing_interpolant(float);
+void release_frame(struct render_pipeline*, struct terrain_frame*);
 
-float dot_product(const struct vector*, const struct vector*);
+void reload_terrain_config(struct render_pipeline*, struct elevation_map*, struct terrain_config*, const char*, unsigned int);
 
-void create_noise_vectors(struct elevation_map*);
+bool drive_camera(struct camera_driver*, struct camera_state*);
 
-float get_map_elevation(const struct elevation_map*, unsigned int, unsigned int);
+int start_frame_timings(struct frame_timings*, const char*, unsigned int);
 
-void elevation_to_colour(float, struct colour_ramp*, SDL_Color*);
+void record_frame_timings(struct frame_timings*, const struct terrain_frame*, double);
 
-void push_gradient(struct colour_ramp*, float, SDL_Color);
+void stop_frame_timings(struct frame_timings*);
 
-void render_terrain(SDL_Renderer*, const struct elevation_map*, const struct vector*, const unsigned int);
+int run_headless(const struct elevation_map*, struct camera_driver*, const char*, unsigned int, struct frame_timings*);
 
-void render_top_down_map(SDL_Surface*, struct elevation_map*, const struct vector*);
+int run_window(struct elevation_map*, struct terrain_config*, const char*, unsigned int, struct camera_driver*, bool, struct frame_timings*);
 
-SDL_Color hex_to_colour(unsigned int);
+int export_main(int, char**);